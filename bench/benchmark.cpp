@@ -0,0 +1,756 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Benchmarks INVENTREE_DRIVER against MOCK_INVENTREE_SERVER.
+ *
+ * Usage: inventree_benchmark [--parts 1000,10000,100000] [--latency-ms 0] [--iterations 20]
+ *                            [--port 8123] [--terms "10k,capacitor 0603"] [--serve]
+ *                            [--record capture.bin | --replay capture.bin [--replay-scale 1.0]]
+ *                            [--stress 8] [--servers 1] [--type-ahead] [--import 500]
+ *                            [--snapshot catalog.snap] [--library parts.sqlite]
+ *                            [--category "Category 1/Category 5"] [--bom 1000]
+ *
+ * --serve only starts the mock server, which is handy to point KiCad at it.
+ * --stress searches and selects parts from the given number of threads on a single driver while
+ * another thread keeps reconnecting it, the exit code is non-zero if a call got lost or failed.
+ * Build with -fsanitize=thread to check the driver for data races.
+ * --servers starts several mock servers on consecutive ports and connects the driver to all of
+ * them (federated search).
+ * --type-ahead searches every prefix of each term, like a user typing it, to measure how many
+ * searches the driver answers from earlier results.
+ * --import creates the given number of parts with addPartsToWareHouse(...) and reports the
+ * throughput, --parallelism sets the number of parts created at the same time. Meanwhile another
+ * thread keeps searching, to show how much the import slows down interactive use.
+ * --snapshot keeps a catalog snapshot per server in the given file (with ".<n>" appended for
+ * further servers), the second run connects from it. Use it with a single --parts size, the
+ * mock servers of all sizes share their url.
+ * --library exports the catalog of the first --parts size to a SQLite database library twice and
+ * reports the time of the full and of the incremental export. The part number index loads at the
+ * same time, the run fails if its part list request and the export's one shared a response.
+ * --category limits the searches to a category of the mock catalog and its subcategories.
+ * --bom loads the part number index of the first --parts size and looks up the given number of
+ * IPNs, manufacturer and supplier part numbers, written the way a BOM might have them. It fails
+ * if a part created while the index loads is missing from it afterwards.
+ * --record writes the traffic of the run to a capture file, --replay runs the benchmark against
+ * a capture (e.g. one recorded from a production server) instead of the mock server.
+ */
+
+#include "mock_inventree_server.h"
+#include "../inventree.h"
+#include "../part_number_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock CLOCK;
+
+struct BENCH_OPTIONS {
+    std::vector<int> m_partCounts = {1000, 10000, 100000};
+    int m_latencyMs = 0;
+    int m_iterations = 20;
+    int m_port = 8123;
+    bool m_serve = false;
+    int m_stressThreads = 0;
+    int m_servers = 1;
+    bool m_typeAhead = false;
+    int m_import = 0;
+    int m_parallelism = 4;
+    std::vector<std::string> m_terms = {"10k", "capacitor 0603", "IPN-1000", "lot 5", "LED 47u"};
+    std::string m_snapshot;
+    std::string m_library;
+    std::string m_category;
+    int m_bom = 0;
+    std::string m_record;
+    std::string m_replay;
+    std::string m_replayScale = "1.0";
+};
+
+struct BENCH_RESULT {
+    int m_parts = 0;
+    double m_connectMs = 0;
+    std::vector<double> m_searchMs;
+    std::vector<double> m_selectMs;
+    size_t m_hits = 0;
+    double m_rssMB = 0;
+    size_t m_requests = 0;
+    std::map<std::string, double> m_metrics;
+};
+
+double elapsedMs(CLOCK::time_point start) {
+    return std::chrono::duration<double, std::milli>(CLOCK::now() - start).count();
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty())
+        return 0;
+
+    std::sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+    return samples[std::min(idx, samples.size() - 1)];
+}
+
+// resident set size of this process, 0 where unsupported
+double residentMB() {
+#if defined(__linux__)
+    long pages = 0;
+    long resident = 0;
+
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#else
+    return 0;
+#endif
+}
+
+std::vector<std::string> parseList(const char *arg) {
+    std::vector<std::string> values;
+    std::stringstream stream(arg);
+    std::string item;
+
+    while (std::getline(stream, item, ','))
+        values.push_back(item);
+
+    return values;
+}
+
+BENCH_OPTIONS parseOptions(int argc, char **argv) {
+    BENCH_OPTIONS options;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--parts") && hasValue) {
+            options.m_partCounts.clear();
+            for (const auto &count : parseList(argv[++i]))
+                options.m_partCounts.push_back(atoi(count.c_str()));
+        } else if (!strcmp(argv[i], "--terms") && hasValue)
+            options.m_terms = parseList(argv[++i]);
+        else if (!strcmp(argv[i], "--snapshot") && hasValue)
+            options.m_snapshot = argv[++i];
+        else if (!strcmp(argv[i], "--library") && hasValue)
+            options.m_library = argv[++i];
+        else if (!strcmp(argv[i], "--bom") && hasValue)
+            options.m_bom = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--category") && hasValue)
+            options.m_category = argv[++i];
+        else if (!strcmp(argv[i], "--record") && hasValue)
+            options.m_record = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && hasValue)
+            options.m_replay = argv[++i];
+        else if (!strcmp(argv[i], "--replay-scale") && hasValue)
+            options.m_replayScale = argv[++i];
+        else if (!strcmp(argv[i], "--latency-ms") && hasValue)
+            options.m_latencyMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--iterations") && hasValue)
+            options.m_iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--port") && hasValue)
+            options.m_port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stress") && hasValue)
+            options.m_stressThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--servers") && hasValue)
+            options.m_servers = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--serve"))
+            options.m_serve = true;
+        else if (!strcmp(argv[i], "--type-ahead"))
+            options.m_typeAhead = true;
+        else if (!strcmp(argv[i], "--import") && hasValue)
+            options.m_import = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--parallelism") && hasValue)
+            options.m_parallelism = atoi(argv[++i]);
+    }
+
+    if (options.m_typeAhead) {
+        std::vector<std::string> prefixes;
+
+        for (const auto &term : options.m_terms) {
+            for (size_t len = 1; len <= term.size(); len++) {
+                if (term[len - 1] != ' ')
+                    prefixes.push_back(term.substr(0, len));
+            }
+        }
+
+        options.m_terms = prefixes;
+    }
+
+    return options;
+}
+
+std::map<wxString, wxString> connectionArgs(const BENCH_OPTIONS &options) {
+    std::map<wxString, wxString> args;
+    args["server_url"] = "http://127.0.0.1";
+    args["server_port"] = wxString(std::to_string(options.m_port));
+
+    for (int i = 1; i < options.m_servers; i++) {
+        wxString suffix = wxString::Format(".%d", i);
+        args["server_url" + suffix] = "http://127.0.0.1";
+        args["server_port" + suffix] = wxString(std::to_string(options.m_port + i));
+        args["server_tag" + suffix] = wxString("mock" + std::to_string(i));
+    }
+    args["username"] = "bench";
+    args["password"] = "bench";
+
+    for (int i = 0; !options.m_snapshot.empty() && i < options.m_servers; i++) {
+        wxString suffix = i ? wxString::Format(".%d", i) : wxString();
+        args["snapshot_file" + suffix] = options.m_snapshot + suffix;
+    }
+
+    if (!options.m_replay.empty()) {
+        args["traffic_replay"] = options.m_replay;
+        args["traffic_replay_scale"] = options.m_replayScale;
+    } else if (!options.m_record.empty()) {
+        args["traffic_record"] = options.m_record;
+    }
+
+    return args;
+}
+
+// one mock server per configured server, none if a capture is replayed
+std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> startServers(const BENCH_OPTIONS &options,
+                                                                 const MOCK_CATALOG_CONFIG &config) {
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers;
+
+    for (int i = 0; i < options.m_servers && options.m_replay.empty(); i++) {
+        servers.emplace_back(new MOCK_INVENTREE_SERVER(
+                "http://127.0.0.1:" + std::to_string(options.m_port + i) + "/", config));
+        servers.back()->open();
+    }
+
+    return servers;
+}
+
+size_t stopServers(std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> &servers) {
+    size_t requests = 0;
+
+    for (auto &server : servers) {
+        requests += server->requestCount();
+        server->close();
+    }
+
+    return requests;
+}
+
+BENCH_RESULT runBenchmark(const BENCH_OPTIONS &options, int parts) {
+    BENCH_RESULT result;
+    result.m_parts = parts;
+
+    MOCK_CATALOG_CONFIG config;
+    config.m_parts = parts;
+    config.m_latencyMs = options.m_latencyMs;
+
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers = startServers(options, config);
+
+    double rssBefore = residentMB();
+
+    {
+        std::unique_ptr<INVENTREE_DRIVER> driver(new INVENTREE_DRIVER());
+        IWareHouse *warehouse = driver.get();
+
+        size_t found = 0;
+        size_t details = 0;
+
+        warehouse->CallbackForFoundParts([&](std::vector<wxString> parts, int) {
+            found = parts.size();
+        });
+        warehouse->CallbackForPartDetails([&](std::map<wxString, wxString>, int) {
+            details++;
+        });
+        warehouse->CallbackForStatusMessage([](const wxString &, const wxString &,
+                                               IWareHouse::Display) {});
+
+        CLOCK::time_point start = CLOCK::now();
+        if (!warehouse->connectToWarehouse(connectionArgs(options), 1))
+            std::cerr << "Failed to connect to mock server" << std::endl;
+        result.m_connectMs = elapsedMs(start);
+
+        for (int i = 0; i < options.m_iterations && !options.m_terms.empty(); i++) {
+            start = CLOCK::now();
+            if (options.m_category.empty())
+                warehouse->searchWareHouseForParts(options.m_terms[i % options.m_terms.size()]);
+            else
+                driver->searchWareHouseForPartsInCategory(
+                        options.m_terms[i % options.m_terms.size()], options.m_category);
+            result.m_searchMs.push_back(elapsedMs(start));
+            result.m_hits += found;
+
+            if (found == 0)
+                continue;
+
+            start = CLOCK::now();
+            warehouse->getSelectedPartParameters(static_cast<int>(i % found));
+            result.m_selectMs.push_back(elapsedMs(start));
+        }
+
+        result.m_rssMB = residentMB() - rssBefore;
+        result.m_metrics = driver->metrics();
+
+        if (details != result.m_selectMs.size())
+            std::cerr << "Only " << details << " part detail callback(s) received" << std::endl;
+    }
+
+    result.m_requests = stopServers(servers);
+
+    return result;
+}
+
+int runStress(const BENCH_OPTIONS &options) {
+    MOCK_CATALOG_CONFIG config;
+    config.m_parts = options.m_partCounts.empty() ? 1000 : options.m_partCounts.front();
+    config.m_latencyMs = options.m_latencyMs;
+
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers = startServers(options, config);
+
+    std::atomic<size_t> searchCallbacks{0};
+    std::atomic<size_t> detailCallbacks{0};
+    std::atomic<size_t> emptyDetails{0};
+    std::atomic<size_t> reconnects{0};
+    std::atomic<size_t> failedReconnects{0};
+    size_t calls = 0;
+    double seconds = 0;
+    std::map<std::string, double> metrics;
+
+    {
+        std::unique_ptr<INVENTREE_DRIVER> driver(new INVENTREE_DRIVER());
+        IWareHouse *warehouse = driver.get();
+
+        warehouse->CallbackForFoundParts([&](std::vector<wxString>, int) {
+            searchCallbacks++;
+        });
+        warehouse->CallbackForPartDetails([&](std::map<wxString, wxString> params, int) {
+            detailCallbacks++;
+            if (params.empty())
+                emptyDetails++;
+        });
+        warehouse->CallbackForStatusMessage([](const wxString &, const wxString &,
+                                               IWareHouse::Display) {});
+
+        if (!warehouse->connectToWarehouse(connectionArgs(options), 1)) {
+            std::cerr << "Failed to connect to mock server" << std::endl;
+            return 1;
+        }
+
+        std::atomic<bool> running{true};
+        std::vector<std::thread> workers;
+        CLOCK::time_point start = CLOCK::now();
+
+        for (int t = 0; t < options.m_stressThreads; t++) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < options.m_iterations && !options.m_terms.empty(); i++) {
+                    warehouse->searchWareHouseForParts(
+                            options.m_terms[(t + i) % options.m_terms.size()]);
+
+                    // the list may already be the one of another thread's search
+                    warehouse->getSelectedPartParameters(0);
+                }
+            });
+        }
+
+        // reconnecting republishes the reference data while the workers read it
+        std::thread reconnect([&] {
+            while (running) {
+                if (!warehouse->connectToWarehouse(connectionArgs(options), 1))
+                    failedReconnects++;
+                reconnects++;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        });
+
+        for (auto &worker : workers)
+            worker.join();
+
+        seconds = elapsedMs(start) / 1000.0;
+        running = false;
+        reconnect.join();
+
+        calls = static_cast<size_t>(options.m_stressThreads) * options.m_iterations;
+        metrics = driver->metrics();
+    }
+
+    stopServers(servers);
+
+    printf("%d thread(s), %zu search(es) in %.2f s (%.1f/s), %zu detail(s), %zu reconnect(s)\n",
+           options.m_stressThreads, searchCallbacks.load(), seconds,
+           seconds > 0 ? searchCallbacks.load() / seconds : 0.0, detailCallbacks.load(),
+           reconnects.load());
+    printf("%.0f of %.0f request(s) coalesced (%.1f%%)\n", metrics["coalesced_requests"],
+           metrics["json_requests"], metrics["coalescing_rate"] * 100);
+
+    bool failed = false;
+
+    if (searchCallbacks != calls) {
+        std::cerr << "Expected " << calls << " search callback(s), got " << searchCallbacks
+                  << std::endl;
+        failed = true;
+    }
+
+    if (emptyDetails || failedReconnects) {
+        std::cerr << emptyDetails << " empty part detail(s), " << failedReconnects
+                  << " failed reconnect(s)" << std::endl;
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
+
+int runImport(const BENCH_OPTIONS &options) {
+    MOCK_CATALOG_CONFIG config;
+    config.m_latencyMs = options.m_latencyMs;
+
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers = startServers(options, config);
+
+    // distributor shaped data, the parameter templates do not exist on the server yet
+    std::vector<std::map<wxString, wxString>> parts;
+    for (int i = 0; i < options.m_import; i++) {
+        std::map<wxString, wxString> part;
+        part["Manufacturer Part Number"] = wxString("BULK-" + std::to_string(i));
+        part["Description"] = wxString("Imported resistor " + std::to_string(i));
+        part["Resistance"] = wxString(std::to_string(i % 100) + "k");
+        part["Tolerance"] = "1%";
+        part["Package"] = "0603";
+        part["Power"] = "0.1W";
+        parts.push_back(part);
+    }
+
+    size_t created = 0;
+    double seconds = 0;
+    std::vector<double> searchMs;
+    std::map<std::string, double> metrics;
+
+    {
+        std::unique_ptr<INVENTREE_DRIVER> driver(new INVENTREE_DRIVER());
+        IWareHouse *warehouse = driver.get();
+
+        warehouse->CallbackForStatusMessage([](const wxString &, const wxString &,
+                                               IWareHouse::Display) {});
+        warehouse->CallbackForFoundParts([](std::vector<wxString>, int) {});
+
+        std::map<wxString, wxString> args = connectionArgs(options);
+        args["bulk_parallelism"] = wxString(std::to_string(options.m_parallelism));
+
+        // every search has to go to the server
+        args["search_cache_size"] = "0";
+
+        if (!warehouse->connectToWarehouse(args, 1)) {
+            std::cerr << "Failed to connect to mock server" << std::endl;
+            return 1;
+        }
+
+        std::atomic<bool> importing{true};
+
+        std::thread searcher([&]() {
+            for (size_t i = 0; importing; i++) {
+                CLOCK::time_point start = CLOCK::now();
+                warehouse->searchWareHouseForParts(options.m_terms[i % options.m_terms.size()]);
+                searchMs.push_back(elapsedMs(start));
+            }
+        });
+
+        CLOCK::time_point start = CLOCK::now();
+        created = driver->addPartsToWareHouse(parts, [&](size_t done, size_t total) {
+            if (done % 100 == 0 || done == total)
+                std::cerr << done << "/" << total << "\r";
+        });
+        seconds = elapsedMs(start) / 1000.0;
+        std::cerr << std::endl;
+
+        importing = false;
+        searcher.join();
+
+        metrics = driver->metrics();
+    }
+
+    size_t requests = stopServers(servers);
+
+    printf("%zu of %zu part(s) created in %.2f s (%.1f/s), %zu request(s)\n", created,
+           parts.size(), seconds, seconds > 0 ? created / seconds : 0.0, requests);
+    printf("%zu search(es) meanwhile, p50 %.2f ms, p95 %.2f ms\n", searchMs.size(),
+           percentile(searchMs, 0.5), percentile(searchMs, 0.95));
+    printf("waiting in the executor: interactive %.2f ms, background %.2f ms (peak %.0f queued)\n",
+           metrics["interactive_wait_ms"], metrics["background_wait_ms"],
+           metrics["background_peak_queue_depth"]);
+
+    return created == parts.size() ? 0 : 1;
+}
+
+void printResult(const BENCH_RESULT &r) {
+    std::map<std::string, double> m = r.m_metrics;
+
+    printf("%8d %11.1f %9.2f %9.2f %9.2f %9.2f %9zu %8.1f %9zu %9.2f %6.1f %9.1f %7.0f\n",
+           r.m_parts, r.m_connectMs, percentile(r.m_searchMs, 0.5), percentile(r.m_searchMs, 0.95),
+           percentile(r.m_selectMs, 0.5), percentile(r.m_selectMs, 0.95),
+           r.m_searchMs.empty() ? 0 : r.m_hits / r.m_searchMs.size(), r.m_rssMB, r.m_requests,
+           m["wire_bytes"] / (1024.0 * 1024.0), m["compression_ratio"], m["decode_ms"],
+           m["search_cache_hits"]);
+}
+
+// numbers added while a table is loaded must survive its replacement
+bool checkPartNumberIndex() {
+    PART_NUMBER_INDEX index;
+    const int added = 1000;
+
+    index.replace(0, PART_NUMBER_INDEX::TABLE());
+    index.beginLoad(0);
+
+    // half of the numbers are added before the loaded table replaces the old one, half after
+    std::thread adding([&index]() {
+        for (int pk = 1; pk <= added; pk++)
+            index.add(0, "NEW-" + std::to_string(pk), pk);
+    });
+
+    while (index.lookup("NEW-" + std::to_string(added / 2)).empty())
+        std::this_thread::yield();
+
+    PART_NUMBER_INDEX::TABLE loaded;
+    PART_NUMBER_INDEX::add(loaded, "LOADED-1", added + 1);
+    index.replace(0, std::move(loaded));
+
+    adding.join();
+
+    bool complete = !index.lookup("loaded 1").empty();
+    for (int pk = 1; pk <= added; pk++)
+        complete = complete && index.lookup("new-" + std::to_string(pk)).size() == 1;
+
+    return complete;
+}
+
+int runBom(const BENCH_OPTIONS &options) {
+    if (!checkPartNumberIndex()) {
+        std::cerr << "Part numbers added during a load were lost" << std::endl;
+        return 1;
+    }
+
+    MOCK_CATALOG_CONFIG config;
+    config.m_parts = options.m_partCounts.empty() ? 1000 : options.m_partCounts.front();
+
+    // a part is created while the index loads, with a little latency the load is still running
+    config.m_latencyMs = std::max(options.m_latencyMs, 10);
+
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers = startServers(options, config);
+
+    std::unique_ptr<INVENTREE_DRIVER> driver(new INVENTREE_DRIVER());
+    IWareHouse *warehouse = driver.get();
+
+    warehouse->CallbackForStatusMessage([](const wxString &, const wxString &,
+                                           IWareHouse::Display) {});
+
+    std::map<wxString, wxString> args = connectionArgs(options);
+    args["part_number_index"] = "on";
+
+    CLOCK::time_point start = CLOCK::now();
+    if (!warehouse->connectToWarehouse(args, 1)) {
+        std::cerr << "Failed to connect to mock server" << std::endl;
+        return 1;
+    }
+
+    // created while the index loads, the mock server does not list it afterwards
+    std::map<wxString, wxString> created;
+    created["name"] = "BOM check";
+    created["IPN"] = "BOM-NEW-1";
+    warehouse->addPartToWareHouse(created);
+
+    // the index is loaded in the background, the last part is indexed once it is complete
+    std::string last = "IPN-" + std::to_string(100000 + config.m_parts);
+    while (driver->findPartsByNumber(last).empty() && elapsedMs(start) < 120000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    double indexMs = elapsedMs(start);
+
+    if (driver->findPartsByNumber("bom new 1").empty()) {
+        std::cerr << "The part created while the index loaded is not indexed" << std::endl;
+        return 1;
+    }
+
+    // the refinement only matches through a supplier part number, which the search cache knows
+    // from the index
+    size_t found = 0;
+    warehouse->CallbackForFoundParts([&](std::vector<wxString> parts, int) {
+        found = parts.size();
+    });
+
+    warehouse->searchWareHouseForParts("IPN-1000");
+    warehouse->searchWareHouseForParts("IPN-1000 311-5-");
+
+    if (found != 1) {
+        std::cerr << "A refined search found " << found << " instead of 1 part(s)" << std::endl;
+        return 1;
+    }
+    size_t requests = servers.front()->requestCount();
+
+    // lower case, other separators, spaces, like numbers typed into a BOM
+    size_t hits = 0;
+    start = CLOCK::now();
+
+    for (int i = 0; i < options.m_bom; i++) {
+        int pk = 1 + i % config.m_parts;
+        std::string number;
+
+        if (i % 3 == 0)
+            number = "ipn " + std::to_string(100000 + pk);
+        else if (i % 3 == 1)
+            number = MOCK_INVENTREE_SERVER::manufacturerPartNumber(pk) + " ";
+        else
+            number = "311." + std::to_string(pk) + ".1.nd";
+
+        if (!driver->findPartsByNumber(number).empty())
+            hits++;
+    }
+
+    double lookupMs = elapsedMs(start);
+
+    printf("%8d part(s) indexed in %.1f ms, %d lookup(s) in %.2f ms (%.2f us each), %zu hit(s), "
+           "%zu request(s) during the lookups\n", config.m_parts, indexMs, options.m_bom, lookupMs,
+           lookupMs * 1000.0 / options.m_bom, hits, servers.front()->requestCount() - requests);
+
+    driver.reset();
+    stopServers(servers);
+
+    return hits == static_cast<size_t>(options.m_bom) ? 0 : 1;
+}
+
+int runLibrary(const BENCH_OPTIONS &options) {
+    MOCK_CATALOG_CONFIG config;
+    config.m_parts = options.m_partCounts.empty() ? 1000 : options.m_partCounts.front();
+
+    // the part number index loads the part list while the first export asks for it, with a
+    // little latency both requests are in flight at once
+    config.m_latencyMs = std::max(options.m_latencyMs, 10);
+
+    std::vector<std::unique_ptr<MOCK_INVENTREE_SERVER>> servers = startServers(options, config);
+
+    std::unique_ptr<INVENTREE_DRIVER> driver(new INVENTREE_DRIVER());
+    IWareHouse *warehouse = driver.get();
+
+    warehouse->CallbackForStatusMessage([](const wxString &, const wxString &,
+                                           IWareHouse::Display) {});
+
+    std::map<wxString, wxString> args = connectionArgs(options);
+    args["part_number_index"] = "on";
+
+    if (!warehouse->connectToWarehouse(args, 1)) {
+        std::cerr << "Failed to connect to mock server" << std::endl;
+        return 1;
+    }
+
+    // the second export finds every part unchanged
+    const char *runs[] = {"full", "incremental"};
+
+    for (const char *run : runs) {
+        CLOCK::time_point start = CLOCK::now();
+        long written = driver->exportDatabaseLibrary(options.m_library,
+                                                     options.m_library + ".kicad_dbl");
+
+        if (written < 0) {
+            std::cerr << "Export to " << options.m_library << " failed" << std::endl;
+            return 1;
+        }
+
+        printf("%-12s %8d part(s) %8ld written %10.1f ms\n", run, config.m_parts, written,
+               elapsedMs(start));
+    }
+
+    // the export asks for complete parts, the index only for their numbers, neither of them may
+    // get the answer to the other's request
+    std::string last = "IPN-" + std::to_string(100000 + config.m_parts);
+    CLOCK::time_point start = CLOCK::now();
+
+    while (driver->findPartsByNumber(last).empty() && elapsedMs(start) < 120000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    size_t projections = servers.empty() ? 2 : servers.front()->partListProjections().size();
+
+    driver.reset();
+    stopServers(servers);
+
+    if (projections < 2) {
+        std::cerr << "Part list requests with different fields were answered with one response"
+                  << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    BENCH_OPTIONS options = parseOptions(argc, argv);
+
+    if (options.m_serve) {
+        MOCK_CATALOG_CONFIG config;
+        config.m_parts = options.m_partCounts.empty() ? 1000 : options.m_partCounts.front();
+        config.m_latencyMs = options.m_latencyMs;
+
+        MOCK_INVENTREE_SERVER server("http://127.0.0.1:" + std::to_string(options.m_port) + "/",
+                                     config);
+        server.open();
+
+        std::cout << "Mock InvenTree serving " << config.m_parts << " part(s) on port "
+                  << options.m_port << ", press enter to stop" << std::endl;
+        std::cin.get();
+
+        return 0;
+    }
+
+    if (options.m_stressThreads > 0)
+        return runStress(options);
+
+    if (options.m_import > 0)
+        return runImport(options);
+
+    if (!options.m_library.empty())
+        return runLibrary(options);
+
+    if (options.m_bom > 0)
+        return runBom(options);
+
+    printf("%8s %11s %9s %9s %9s %9s %9s %8s %9s %9s %6s %9s %7s\n", "parts", "connect ms",
+           "search50", "search95", "select50", "select95", "hits", "rss MB", "requests", "wire MB",
+           "ratio", "decode ms", "cached");
+
+    if (!options.m_replay.empty()) {
+        printResult(runBenchmark(options, 0));
+        return 0;
+    }
+
+    for (int parts : options.m_partCounts)
+        printResult(runBenchmark(options, parts));
+
+    return 0;
+}
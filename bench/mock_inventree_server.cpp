@@ -0,0 +1,583 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "mock_inventree_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace web;
+using namespace web::http;
+using namespace web::http::experimental::listener;
+
+namespace {
+const char *PART_TYPES[] = {"Resistor", "Capacitor", "Inductor", "Diode", "LED", "MOSFET"};
+const char *PART_PREFIXES[] = {"R", "C", "L", "D", "LED", "Q"};
+const char *PART_VALUES[] = {"1", "2.2", "4.7", "10", "22", "47", "100", "220", "470"};
+const char *VALUE_UNITS[] = {"", "k", "M", "n", "u", "p"};
+const char *PACKAGES[] = {"0402", "0603", "0805", "1206", "SOT-23", "SOD-123"};
+}
+
+MOCK_INVENTREE_SERVER::MOCK_INVENTREE_SERVER(const std::string &url, MOCK_CATALOG_CONFIG config)
+        : m_config(config), m_listener(url) {
+    m_parts.reserve(config.m_parts);
+
+    // derive a deterministic, realistically shaped catalog from the pk
+    for (int pk = 1; pk <= config.m_parts; pk++) {
+        int type = pk % 6;
+        std::string value = std::string(PART_VALUES[(pk / 6) % 9]) + VALUE_UNITS[(pk / 54) % 6];
+        std::string package = PACKAGES[(pk / 324) % 6];
+
+        MOCK_PART part;
+        part.m_pk = pk;
+        part.m_name = std::string(PART_PREFIXES[type]) + "_" + value + "_" + package;
+        part.m_IPN = "IPN-" + std::to_string(100000 + pk);
+        part.m_description = std::string(PART_TYPES[type]) + " " + value + " " + package +
+                             ", general purpose, automotive grade, RoHS compliant, lot " +
+                             std::to_string(pk);
+
+        m_parts.emplace_back(part);
+    }
+
+    // the content does not matter, only the amount of data which has to be transferred
+    m_image.resize(config.m_imageBytes);
+    for (size_t i = 0; i < m_image.size(); i++)
+        m_image[i] = static_cast<unsigned char>(i * 31 + 7);
+
+    m_listener.support(methods::GET, [this](http_request request) { handleGet(request); });
+    m_listener.support(methods::POST, [this](http_request request) { handlePost(request); });
+}
+
+MOCK_INVENTREE_SERVER::~MOCK_INVENTREE_SERVER() {
+    try {
+        close();
+    }
+    catch (...) {
+        // listener was not open
+    }
+}
+
+void MOCK_INVENTREE_SERVER::open() {
+    m_listener.open().wait();
+}
+
+void MOCK_INVENTREE_SERVER::close() {
+    m_listener.close().wait();
+}
+
+std::set<std::string> MOCK_INVENTREE_SERVER::partListProjections() const {
+    std::lock_guard<std::mutex> lock(m_projectionMutex);
+    return m_partListProjections;
+}
+
+void MOCK_INVENTREE_SERVER::handleGet(http_request request) {
+    m_requests++;
+
+    if (m_config.m_latencyMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_config.m_latencyMs));
+
+    std::vector<std::string> path = uri::split_path(uri::decode(request.relative_uri().path()));
+    std::map<std::string, std::string> query = uri::split_query(request.relative_uri().query());
+
+    for (auto &q : query)
+        q.second = uri::decode(q.second);
+
+    if (path.size() >= 2 && path[0] == "media") {
+        http_response response(status_codes::OK);
+        response.headers().set_content_type("image/png");
+        response.set_body(m_image);
+        request.reply(response);
+        return;
+    }
+
+    if (path.empty() || path[0] != "api") {
+        request.reply(status_codes::NotFound);
+        return;
+    }
+
+    path.erase(path.begin());
+
+    if (path.empty()) {
+        replyJSON(request, apiVersion());
+    } else if (path.size() == 2 && path[0] == "user" && path[1] == "token") {
+        json::value token = json::value::object();
+        token[U("token")] = json::value::string("0123456789abcdef0123456789abcdef01234567");
+        replyJSON(request, token);
+    } else if (path.size() == 1 && path[0] == "part") {
+        if (query.count("search") == 0 && query.count("category") == 0 &&
+            query.count("pk__in") == 0) {
+            std::lock_guard<std::mutex> lock(m_projectionMutex);
+            m_partListProjections.insert(query.count("fields") ? query["fields"] : "");
+        }
+
+        replyJSON(request, searchParts(query));
+    } else if (path.size() == 2 && path[0] == "part" && path[1] == "parameter") {
+        // without a part, the parameters of all parts are listed
+        if (query.count("part")) {
+            replyJSON(request, partParameters(atoi(query["part"].c_str())));
+        } else {
+            std::vector<json::value> params;
+
+            for (const auto &part : m_parts) {
+                for (const auto &param : partParameters(part.m_pk).as_array())
+                    params.push_back(param);
+            }
+
+            replyJSON(request, json::value::array(params));
+        }
+    } else if (path.size() == 3 && path[0] == "part" && path[1] == "parameter" &&
+               path[2] == "template") {
+        replyJSON(request, parameterTemplates());
+    } else if (path.size() == 2 && path[0] == "part" && path[1] == "category") {
+        replyJSON(request, partCategories());
+    } else if (path.size() == 3 && path[0] == "company" && path[1] == "part" &&
+               path[2] == "manufacturer") {
+        replyJSON(request, manufacturerParts());
+    } else if (path.size() == 2 && path[0] == "company" && path[1] == "part") {
+        replyJSON(request, supplierParts());
+    } else if (path.size() == 2 && path[0] == "part") {
+        int pk = atoi(path[1].c_str());
+
+        if (pk < 1 || pk > static_cast<int>(m_parts.size())) {
+            request.reply(status_codes::NotFound);
+            return;
+        }
+
+        replyJSON(request, partDetail(m_parts[pk - 1]));
+    } else if (path.size() == 2 && path[0] == "stock" && path[1] == "location") {
+        replyJSON(request, stockLocations());
+    } else {
+        request.reply(status_codes::NotFound);
+    }
+}
+
+void MOCK_INVENTREE_SERVER::handlePost(http_request request) {
+    m_requests++;
+
+    if (m_config.m_latencyMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_config.m_latencyMs));
+
+    std::vector<std::string> path = uri::split_path(uri::decode(request.relative_uri().path()));
+
+    json::value body;
+    try {
+        body = request.extract_json(true).get();
+    }
+    catch (...) {
+        request.reply(status_codes::BadRequest);
+        return;
+    }
+
+    if (path.size() < 2 || path[0] != "api" || !body.is_object()) {
+        request.reply(status_codes::NotFound);
+        return;
+    }
+
+    path.erase(path.begin());
+
+    // like the REST framework, reject objects without their required fields
+    const char *required = nullptr;
+    int pk = 0;
+
+    if (path.size() == 1 && path[0] == "part") {
+        required = "name";
+        pk = m_config.m_parts + ++m_createdParts;
+    } else if (path.size() == 2 && path[0] == "part" && path[1] == "parameter") {
+        required = "template";
+        pk = ++m_createdParameters;
+    } else if (path.size() == 3 && path[0] == "part" && path[1] == "parameter" &&
+               path[2] == "template") {
+        required = "name";
+        pk = m_config.m_parameterTemplates + ++m_createdTemplates;
+    } else {
+        request.reply(status_codes::NotFound);
+        return;
+    }
+
+    utility::string_t field = utility::conversions::to_string_t(required);
+
+    if (!body.has_field(field)) {
+        json::value error = json::value::object();
+        error[field] = json::value::array({json::value::string("This field is required.")});
+        replyJSON(request, error, status_codes::BadRequest);
+        return;
+    }
+
+    body[U("pk")] = json::value::number(pk);
+    replyJSON(request, body, status_codes::Created);
+}
+
+void MOCK_INVENTREE_SERVER::replyJSON(const http_request &request, const json::value &body,
+                                      status_code status) const {
+    std::map<std::string, std::string> query = uri::split_query(request.relative_uri().query());
+
+    std::string text = body.serialize();
+
+    if (m_config.m_fieldProjection && query.count("fields"))
+        text = projectFields(body, uri::decode(query["fields"])).serialize();
+
+    // like Django's ConditionalGetMiddleware
+    std::string etag = "\"" + std::to_string(std::hash<std::string>()(text)) + "\"";
+    utility::string_t ifNoneMatch;
+
+    if (status == status_codes::OK && request.headers().match(header_names::if_none_match,
+                                                              ifNoneMatch) &&
+        ifNoneMatch == etag) {
+        http_response notModified(status_codes::NotModified);
+        notModified.headers().add(header_names::etag, etag);
+        request.reply(notModified);
+        return;
+    }
+
+    utility::string_t accepted;
+    request.headers().match(header_names::accept_encoding, accepted);
+
+    std::unique_ptr<compression::compress_provider> compressor;
+    if (m_config.m_compress && accepted.find(U("gzip")) != utility::string_t::npos)
+        compressor = compression::builtin::make_compressor(compression::builtin::algorithm::GZIP);
+
+    if (!compressor) {
+        http_response response(status);
+        response.set_body(text, U("application/json"));
+
+        if (status == status_codes::OK)
+            response.headers().add(header_names::etag, etag);
+
+        request.reply(response);
+        return;
+    }
+
+    std::vector<unsigned char> compressed;
+    std::vector<uint8_t> chunk(64 * 1024);
+    size_t offset = 0;
+    bool done = false;
+
+    while (!done) {
+        size_t used = 0;
+        size_t produced = compressor->compress(
+                reinterpret_cast<const uint8_t *>(text.data()) + offset, text.size() - offset,
+                chunk.data(), chunk.size(), compression::operation_hint::is_last, used, done);
+
+        compressed.insert(compressed.end(), chunk.begin(), chunk.begin() + produced);
+        offset += used;
+    }
+
+    http_response response(status);
+    response.set_body(std::move(compressed));
+    response.headers().set_content_type(U("application/json"));
+    response.headers().add(header_names::content_encoding, U("gzip"));
+
+    if (status == status_codes::OK)
+        response.headers().add(header_names::etag, etag);
+
+    request.reply(response);
+}
+
+json::value MOCK_INVENTREE_SERVER::projectFields(const json::value &body,
+                                                const std::string &fields) {
+    if (body.is_array()) {
+        std::vector<json::value> items;
+
+        for (const auto &item : body.as_array())
+            items.emplace_back(projectFields(item, fields));
+
+        return json::value::array(items);
+    }
+
+    if (!body.is_object())
+        return body;
+
+    // paginated result
+    if (body.has_field(U("results"))) {
+        json::value page = body;
+        page[U("results")] = projectFields(body.at(U("results")), fields);
+        return page;
+    }
+
+    json::value projected = json::value::object();
+    std::stringstream stream(fields);
+    std::string field;
+
+    while (std::getline(stream, field, ',')) {
+        if (body.has_field(field))
+            projected[field] = body.at(field);
+    }
+
+    return projected;
+}
+
+json::value MOCK_INVENTREE_SERVER::apiVersion() const {
+    json::value version = json::value::object();
+    version[U("server")] = json::value::string("InvenTree");
+    version[U("version")] = json::value::string("0.2.4 mock");
+    version[U("instance")] = json::value::string("Mock InvenTree");
+    version[U("apiVersion")] = json::value::number(4);
+
+    return version;
+}
+
+json::value MOCK_INVENTREE_SERVER::searchParts(const std::map<std::string, std::string> &query)
+const {
+    std::vector<std::string> terms;
+
+    auto search = query.find("search");
+    if (search != query.end()) {
+        std::istringstream stream(toLower(search->second));
+        std::string term;
+
+        while (stream >> term)
+            terms.emplace_back(term);
+    }
+
+    // comma separated pks, e.g. the parts whose stock is polled
+    std::set<int> pks;
+    auto pkIn = query.find("pk__in");
+    if (pkIn != query.end()) {
+        std::stringstream stream(pkIn->second);
+        std::string pk;
+
+        while (std::getline(stream, pk, ','))
+            pks.insert(atoi(pk.c_str()));
+    }
+
+    // a category, with "cascade" including its subcategories
+    int category = query.count("category") ? atoi(query.at("category").c_str()) : 0;
+    bool cascade = query.count("cascade") && query.at("cascade") != "0" &&
+                   query.at("cascade") != "false";
+
+    std::vector<json::value> hits;
+    for (const auto &part : m_parts) {
+        if (!matchesSearch(part, terms) || (pkIn != query.end() && !pks.count(part.m_pk)))
+            continue;
+
+        if (category) {
+            int c = categoryOf(part);
+            while (cascade && c != category && c != 0)
+                c = categoryParent(c);
+
+            if (c != category)
+                continue;
+        }
+
+        hits.emplace_back(partDetail(part));
+    }
+
+    // InvenTree only paginates if a limit has been requested
+    auto limit = query.find("limit");
+    if (limit == query.end())
+        return json::value::array(hits);
+
+    size_t offset = query.count("offset") ? std::stoul(query.at("offset")) : 0;
+    size_t count = std::stoul(limit->second);
+
+    std::vector<json::value> page;
+    for (size_t i = offset; i < hits.size() && page.size() < count; i++)
+        page.emplace_back(hits[i]);
+
+    json::value results = json::value::object();
+    results[U("count")] = json::value::number(static_cast<int>(hits.size()));
+    results[U("next")] = json::value::null();
+    results[U("previous")] = json::value::null();
+    results[U("results")] = json::value::array(page);
+
+    return results;
+}
+
+json::value MOCK_INVENTREE_SERVER::partDetail(const MOCK_PART &part) const {
+    json::value obj = json::value::object();
+
+    obj[U("pk")] = json::value::number(part.m_pk);
+    obj[U("name")] = json::value::string(part.m_name);
+    obj[U("IPN")] = json::value::string(part.m_IPN);
+    obj[U("description")] = json::value::string(part.m_description);
+    obj[U("full_name")] = json::value::string(part.m_IPN + " | " + part.m_name);
+    obj[U("keywords")] = json::value::string(part.m_name + " smd passive");
+    obj[U("category")] = json::value::number(categoryOf(part));
+    obj[U("default_location")] = json::value::number(
+            1 + part.m_pk % std::max(1, m_config.m_stockLocations));
+    obj[U("in_stock")] = json::value::number(static_cast<double>((part.m_pk * 37) % 5000));
+    obj[U("link")] = json::value::string("https://example.com/datasheet/" + part.m_name + ".pdf");
+    obj[U("notes")] = json::value::string("Synthetic part generated by the mock server");
+    obj[U("image")] = json::value::string(
+            "/media/part_images/" + std::to_string(part.m_pk) + ".png");
+    obj[U("thumbnail")] = json::value::string(
+            "/media/part_images/" + std::to_string(part.m_pk) + ".thumbnail.png");
+    obj[U("units")] = json::value::string("pcs");
+    obj[U("revision")] = json::value::string("A");
+    obj[U("tags")] = json::value::array();
+    obj[U("minimum_stock")] = json::value::number(100);
+    obj[U("active")] = json::value::boolean(true);
+    obj[U("assembly")] = json::value::boolean(false);
+    obj[U("component")] = json::value::boolean(true);
+    obj[U("purchaseable")] = json::value::boolean(true);
+    obj[U("salable")] = json::value::boolean(false);
+    obj[U("trackable")] = json::value::boolean(false);
+    obj[U("virtual")] = json::value::boolean(false);
+    obj[U("url")] = json::value::string("/part/" + std::to_string(part.m_pk) + "/");
+
+    return obj;
+}
+
+json::value MOCK_INVENTREE_SERVER::partParameters(int partPk) const {
+    std::vector<json::value> params;
+
+    if (m_config.m_parameterTemplates <= 0)
+        return json::value::array(params);
+
+    for (int i = 0; i < m_config.m_parametersPerPart; i++) {
+        json::value param = json::value::object();
+        param[U("pk")] = json::value::number(partPk * m_config.m_parametersPerPart + i);
+        param[U("part")] = json::value::number(partPk);
+        param[U("template")] = json::value::number(
+                1 + (partPk + i) % m_config.m_parameterTemplates);
+        param[U("data")] = json::value::string(std::to_string((partPk * (i + 3)) % 1000));
+        params.emplace_back(param);
+    }
+
+    return json::value::array(params);
+}
+
+json::value MOCK_INVENTREE_SERVER::parameterTemplates() const {
+    std::vector<json::value> templates;
+
+    for (int pk = 1; pk <= m_config.m_parameterTemplates; pk++) {
+        json::value temp = json::value::object();
+        temp[U("pk")] = json::value::number(pk);
+        temp[U("name")] = json::value::string("parameter_" + std::to_string(pk));
+        temp[U("units")] = json::value::string(pk % 3 == 0 ? "V" : (pk % 3 == 1 ? "Ohm" : "F"));
+        templates.emplace_back(temp);
+    }
+
+    return json::value::array(templates);
+}
+
+json::value MOCK_INVENTREE_SERVER::stockLocations() const {
+    std::vector<json::value> locations;
+
+    // a tree with up to ten children per location
+    for (int pk = 1; pk <= m_config.m_stockLocations; pk++) {
+        int parent = pk > 10 ? pk / 10 : 0;
+
+        json::value loc = json::value::object();
+        loc[U("pk")] = json::value::number(pk);
+        loc[U("parent")] = parent ? json::value::number(parent) : json::value::null();
+        loc[U("items")] = json::value::number((pk * 13) % 200);
+        loc[U("url")] = json::value::string("/stock/location/" + std::to_string(pk) + "/");
+        loc[U("name")] = json::value::string("Location " + std::to_string(pk));
+        loc[U("description")] = json::value::string("Shelf " + std::to_string(pk % 10));
+        loc[U("pathstring")] = json::value::string("Building/Room/Location " + std::to_string(pk));
+        locations.emplace_back(loc);
+    }
+
+    return json::value::array(locations);
+}
+
+json::value MOCK_INVENTREE_SERVER::partCategories() const {
+    std::vector<json::value> categories;
+
+    for (int pk = 1; pk <= CATEGORY_COUNT; pk++) {
+        int parent = categoryParent(pk);
+
+        json::value category = json::value::object();
+        category[U("pk")] = json::value::number(pk);
+        category[U("parent")] = parent ? json::value::number(parent) : json::value::null();
+        category[U("name")] = json::value::string("Category " + std::to_string(pk));
+        category[U("description")] = json::value::string("Group " + std::to_string(pk % 4));
+        categories.emplace_back(category);
+    }
+
+    return json::value::array(categories);
+}
+
+json::value MOCK_INVENTREE_SERVER::manufacturerParts() const {
+    std::vector<json::value> parts;
+
+    for (const auto &part : m_parts) {
+        json::value obj = json::value::object();
+        obj[U("pk")] = json::value::number(part.m_pk);
+        obj[U("part")] = json::value::number(part.m_pk);
+        obj[U("manufacturer")] = json::value::number(1 + part.m_pk % 5);
+        obj[U("MPN")] = json::value::string(manufacturerPartNumber(part.m_pk));
+        parts.emplace_back(obj);
+    }
+
+    return json::value::array(parts);
+}
+
+json::value MOCK_INVENTREE_SERVER::supplierParts() const {
+    std::vector<json::value> parts;
+
+    for (const auto &part : m_parts) {
+        json::value obj = json::value::object();
+        obj[U("pk")] = json::value::number(part.m_pk);
+        obj[U("part")] = json::value::number(part.m_pk);
+        obj[U("supplier")] = json::value::number(6 + part.m_pk % 3);
+        obj[U("SKU")] = json::value::string(supplierPartNumber(part.m_pk));
+        obj[U("MPN")] = json::value::string(manufacturerPartNumber(part.m_pk));
+        parts.emplace_back(obj);
+    }
+
+    return json::value::array(parts);
+}
+
+std::string MOCK_INVENTREE_SERVER::manufacturerPartNumber(int pk) {
+    return "RC0603FR-" + std::to_string(pk) + "KL";
+}
+
+std::string MOCK_INVENTREE_SERVER::supplierPartNumber(int pk) {
+    return "311-" + std::to_string(pk) + "-1-ND";
+}
+
+int MOCK_INVENTREE_SERVER::categoryOf(const MOCK_PART &part) {
+    return 1 + part.m_pk % CATEGORY_COUNT;
+}
+
+int MOCK_INVENTREE_SERVER::categoryParent(int category) {
+    // four top level categories with up to four children each
+    return category > 4 ? (category - 1) / 4 : 0;
+}
+
+bool MOCK_INVENTREE_SERVER::matchesSearch(const MOCK_PART &part,
+                                          const std::vector<std::string> &terms) const {
+    if (terms.empty())
+        return true;
+
+    // the fields InvenTree searches, including the category name and the part numbers
+    std::string haystack = toLower(part.m_name + " " + part.m_IPN + " A " + part.m_description +
+                                   " " + part.m_name + " smd passive Category " +
+                                   std::to_string(categoryOf(part)) + " " +
+                                   manufacturerPartNumber(part.m_pk) + " " +
+                                   supplierPartNumber(part.m_pk));
+
+    // like InvenTree, every word of the search term has to match
+    for (const auto &term : terms) {
+        if (haystack.find(term) == std::string::npos)
+            return false;
+    }
+
+    return true;
+}
+
+std::string MOCK_INVENTREE_SERVER::toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return str;
+}
@@ -0,0 +1,155 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_MOCK_INVENTREE_SERVER_H
+#define INVENTREE_MOCK_INVENTREE_SERVER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cpprest/http_compression.h>
+#include <cpprest/http_listener.h>
+#include <cpprest/json.h>
+
+/**
+ * Size and behaviour of the synthetic catalog served by MOCK_INVENTREE_SERVER
+ */
+struct MOCK_CATALOG_CONFIG {
+    int m_parts = 1000;
+    int m_parameterTemplates = 50;
+    int m_parametersPerPart = 8;
+    int m_stockLocations = 100;
+
+    // artificial delay added to every response
+    int m_latencyMs = 0;
+
+    // size of the dummy image served for every part
+    size_t m_imageBytes = 16 * 1024;
+
+    // gzip JSON responses if the client accepts it
+    bool m_compress = true;
+
+    // honour the "fields" query parameter, like servers with dynamic field support
+    bool m_fieldProjection = true;
+};
+
+/**
+ * A synthetic part as it is kept by the mock server. Everything else is derived from the pk.
+ */
+struct MOCK_PART {
+    int m_pk;
+    std::string m_name;
+    std::string m_IPN;
+    std::string m_description;
+};
+
+/*! A minimal stand-in for the InvenTree REST API, used to benchmark the driver offline.
+ * It serves api/, user/token/, part/, part/<pk>/, part/parameter/, part/parameter/template/,
+ * part/category/, stock/location/, company/part/manufacturer/, company/part/ and the part images
+ * from a catalog generated from MOCK_CATALOG_CONFIG. Every part has one manufacturer and one
+ * supplier part.
+ * JSON responses carry an ETag and conditional requests are answered with 304.
+ * Parts, parameters and parameter templates can be created with POST requests, they are
+ * acknowledged with a new pk but not added to the catalog.
+ * */
+class MOCK_INVENTREE_SERVER {
+public:
+    /*!
+      Generates the catalog, the server is not listening before open() has been called
+      @param[in] url base url to listen on, e.g. http://127.0.0.1:8123/
+      @param[in] config catalog size and latency
+      */
+    MOCK_INVENTREE_SERVER(const std::string &url, MOCK_CATALOG_CONFIG config);
+
+    ~MOCK_INVENTREE_SERVER();
+
+    void open();
+
+    void close();
+
+    // number of requests answered so far
+    size_t requestCount() const { return m_requests.load(); }
+
+    const MOCK_CATALOG_CONFIG &config() const { return m_config; }
+
+    // distinct "fields" of the unfiltered part/ requests answered so far, "" for complete objects
+    std::set<std::string> partListProjections() const;
+
+    // part numbers of the manufacturer and supplier part of a part
+    static std::string manufacturerPartNumber(int pk);
+
+    static std::string supplierPartNumber(int pk);
+
+private:
+    void handleGet(web::http::http_request request);
+
+    void handlePost(web::http::http_request request);
+
+    void replyJSON(const web::http::http_request &request, const web::json::value &body,
+                   web::http::status_code status = web::http::status_codes::OK) const;
+
+    static web::json::value projectFields(const web::json::value &body, const std::string &fields);
+
+    web::json::value apiVersion() const;
+
+    web::json::value searchParts(const std::map<std::string, std::string> &query) const;
+
+    web::json::value partDetail(const MOCK_PART &part) const;
+
+    web::json::value partParameters(int partPk) const;
+
+    web::json::value parameterTemplates() const;
+
+    web::json::value stockLocations() const;
+
+    web::json::value partCategories() const;
+
+    web::json::value manufacturerParts() const;
+
+    web::json::value supplierParts() const;
+
+    static int categoryOf(const MOCK_PART &part);
+
+    // 0 for top level categories
+    static int categoryParent(int category);
+
+    static const int CATEGORY_COUNT = 20;
+
+    bool matchesSearch(const MOCK_PART &part, const std::vector<std::string> &terms) const;
+
+    static std::string toLower(std::string str);
+
+    MOCK_CATALOG_CONFIG m_config;
+    std::vector<MOCK_PART> m_parts;
+    std::vector<unsigned char> m_image;
+
+    std::atomic<size_t> m_requests{0};
+
+    std::set<std::string> m_partListProjections;
+    mutable std::mutex m_projectionMutex;
+
+    // pks handed out to created objects
+    std::atomic<int> m_createdParts{0};
+    std::atomic<int> m_createdParameters{0};
+    std::atomic<int> m_createdTemplates{0};
+    web::http::experimental::listener::http_listener m_listener;
+};
+
+#endif //INVENTREE_MOCK_INVENTREE_SERVER_H
@@ -0,0 +1,441 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "catalog_snapshot.h"
+#include "inventree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const char SNAPSHOT_MAGIC[8] = {'I', 'N', 'V', 'T', 'S', 'N', 'A', 'P'};
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// the tables hold 32 bit fields only, 8 byte alignment keeps every record aligned
+size_t align(size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+/**
+ * String table of a snapshot which is being written, equal strings are stored once
+ */
+class STRING_TABLE {
+public:
+    SNAPSHOT_STRING add(const std::string &str) {
+        auto known = m_index.find(str);
+        if (known != m_index.end())
+            return known->second;
+
+        SNAPSHOT_STRING entry;
+        entry.m_offset = static_cast<uint32_t>(m_data.size());
+        entry.m_length = static_cast<uint32_t>(str.size());
+
+        m_data.append(str);
+        m_data.push_back('\0');
+
+        m_index[str] = entry;
+        return entry;
+    }
+
+    SNAPSHOT_STRING add(const wxString &str) { return add(std::string(str.utf8_str())); }
+
+    const std::string &data() const { return m_data; }
+
+private:
+    std::string m_data;
+    std::unordered_map<std::string, SNAPSHOT_STRING> m_index;
+};
+
+template<typename RECORD>
+const RECORD *findRecord(const RECORD *records, size_t count, int pk) {
+    const RECORD *end = records + count;
+    const RECORD *found = std::lower_bound(records, end, pk, [](const RECORD &r, int key) {
+        return r.m_pk < key;
+    });
+
+    return found != end && found->m_pk == pk ? found : nullptr;
+}
+
+template<typename RECORD>
+void sortByPk(std::vector<RECORD> &records) {
+    std::stable_sort(records.begin(), records.end(), [](const RECORD &a, const RECORD &b) {
+        return a.m_pk < b.m_pk;
+    });
+
+    // a pk is listed once, lookups could not tell duplicates apart anyway
+    records.erase(std::unique(records.begin(), records.end(),
+                              [](const RECORD &a, const RECORD &b) { return a.m_pk == b.m_pk; }),
+                  records.end());
+}
+
+template<typename RECORD>
+void copyTable(std::vector<unsigned char> &file, uint64_t offset,
+               const std::vector<RECORD> &records) {
+    if (!records.empty())
+        memcpy(file.data() + offset, records.data(), records.size() * sizeof(RECORD));
+}
+}
+
+CATALOG_SNAPSHOT::~CATALOG_SNAPSHOT() {
+#ifdef WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+
+    if (m_mapping)
+        CloseHandle(m_mapping);
+
+    if (m_file)
+        CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const CATALOG_SNAPSHOT> CATALOG_SNAPSHOT::open(const std::string &path,
+                                                               std::string *error) {
+    std::shared_ptr<CATALOG_SNAPSHOT> snapshot(new CATALOG_SNAPSHOT());
+    std::string reason;
+
+    if (!snapshot->map(path, reason) || !snapshot->validate(reason)) {
+        if (error)
+            *error = reason;
+
+        return nullptr;
+    }
+
+    return snapshot;
+}
+
+bool CATALOG_SNAPSHOT::map(const std::string &path, std::string &error) {
+#ifdef WIN32
+    // don't lock out writers of other processes, the mapping may still keep them from replacing
+    // the file, they then try again with their next refresh
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "can not open " + path;
+        return false;
+    }
+
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        error = "empty file";
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        error = "can not map " + path;
+        return false;
+    }
+
+    m_data = static_cast<const unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        error = "can not map " + path;
+        return false;
+    }
+
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "can not open " + path;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        error = "empty file";
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        error = "can not map " + path;
+        return false;
+    }
+
+    m_data = static_cast<const unsigned char *>(data);
+    m_size = static_cast<size_t>(info.st_size);
+#endif
+
+    return true;
+}
+
+bool CATALOG_SNAPSHOT::validate(std::string &error) {
+    if (m_size < sizeof(SNAPSHOT_HEADER)) {
+        error = "truncated header";
+        return false;
+    }
+
+    const SNAPSHOT_HEADER *header = reinterpret_cast<const SNAPSHOT_HEADER *>(m_data);
+
+    if (memcmp(header->m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        error = "not a snapshot";
+        return false;
+    }
+
+    if (header->m_version != VERSION || header->m_byteOrder != SNAPSHOT_BYTE_ORDER ||
+        header->m_templateSize != sizeof(SNAPSHOT_TEMPLATE) ||
+        header->m_locationSize != sizeof(SNAPSHOT_LOCATION) ||
+        header->m_partSize != sizeof(SNAPSHOT_PART)) {
+        error = "unsupported version " + std::to_string(header->m_version);
+        return false;
+    }
+
+    if (header->m_fileSize != m_size) {
+        error = "truncated file";
+        return false;
+    }
+
+    auto fits = [this](uint64_t offset, uint64_t bytes) {
+        return offset % 8 == 0 && offset <= m_size && bytes <= m_size - offset;
+    };
+
+    if (!fits(header->m_templates, uint64_t(header->m_templateCount) * header->m_templateSize) ||
+        !fits(header->m_locations, uint64_t(header->m_locationCount) * header->m_locationSize) ||
+        !fits(header->m_parts, uint64_t(header->m_partCount) * header->m_partSize) ||
+        !fits(header->m_strings, header->m_stringsSize)) {
+        error = "table out of range";
+        return false;
+    }
+
+    if (checksum(m_data + sizeof(SNAPSHOT_HEADER), m_size - sizeof(SNAPSHOT_HEADER)) !=
+        header->m_checksum) {
+        error = "checksum mismatch";
+        return false;
+    }
+
+    m_header = header;
+    m_templates = reinterpret_cast<const SNAPSHOT_TEMPLATE *>(m_data + header->m_templates);
+    m_locations = reinterpret_cast<const SNAPSHOT_LOCATION *>(m_data + header->m_locations);
+    m_parts = reinterpret_cast<const SNAPSHOT_PART *>(m_data + header->m_parts);
+    m_strings = reinterpret_cast<const char *>(m_data + header->m_strings);
+
+    return true;
+}
+
+bool CATALOG_SNAPSHOT::write(const std::string &path, const std::string &serverURL,
+                             const std::vector<TEMPLATE_PARAMETER> &templates,
+                             const std::vector<STOCK_LOCATION> &locations,
+                             const std::vector<FOUND_PART> &parts) {
+    STRING_TABLE strings;
+
+    SNAPSHOT_HEADER header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.m_version = VERSION;
+    header.m_byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.m_created = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    header.m_serverURL = strings.add(serverURL);
+
+    std::vector<SNAPSHOT_TEMPLATE> templateRecords;
+    for (const auto &t : templates) {
+        SNAPSHOT_TEMPLATE record;
+        record.m_pk = t.m_pk;
+        record.m_name = strings.add(t.m_name);
+        record.m_units = strings.add(t.m_units);
+        templateRecords.push_back(record);
+    }
+
+    std::vector<SNAPSHOT_LOCATION> locationRecords;
+    for (const auto &l : locations) {
+        SNAPSHOT_LOCATION record;
+        record.m_pk = l.m_pk;
+        record.m_parent = l.m_parent;
+        record.m_items = l.m_items;
+        record.m_url = strings.add(l.m_url);
+        record.m_name = strings.add(l.m_name);
+        record.m_description = strings.add(l.m_description);
+        record.m_pathstring = strings.add(l.m_pathstring);
+        locationRecords.push_back(record);
+    }
+
+    std::vector<SNAPSHOT_PART> partRecords;
+    for (const auto &p : parts) {
+        SNAPSHOT_PART record;
+        record.m_pk = p.m_pk;
+        record.m_category = p.m_category;
+        record.m_description = strings.add(p.m_description);
+        record.m_IPN = strings.add(p.m_IPN);
+        record.m_image = strings.add(p.m_image);
+        record.m_searchText = strings.add(p.m_searchText);
+        partRecords.push_back(record);
+    }
+
+    sortByPk(templateRecords);
+    sortByPk(locationRecords);
+    sortByPk(partRecords);
+
+    header.m_templateCount = static_cast<uint32_t>(templateRecords.size());
+    header.m_templateSize = sizeof(SNAPSHOT_TEMPLATE);
+    header.m_locationCount = static_cast<uint32_t>(locationRecords.size());
+    header.m_locationSize = sizeof(SNAPSHOT_LOCATION);
+    header.m_partCount = static_cast<uint32_t>(partRecords.size());
+    header.m_partSize = sizeof(SNAPSHOT_PART);
+
+    header.m_templates = align(sizeof(SNAPSHOT_HEADER));
+    header.m_locations = align(header.m_templates + templateRecords.size() *
+                                                    sizeof(SNAPSHOT_TEMPLATE));
+    header.m_parts = align(header.m_locations + locationRecords.size() *
+                                                sizeof(SNAPSHOT_LOCATION));
+    header.m_strings = align(header.m_parts + partRecords.size() * sizeof(SNAPSHOT_PART));
+    header.m_stringsSize = strings.data().size();
+    header.m_fileSize = header.m_strings + header.m_stringsSize;
+
+    std::vector<unsigned char> file(header.m_fileSize, 0);
+
+    copyTable(file, header.m_templates, templateRecords);
+    copyTable(file, header.m_locations, locationRecords);
+    copyTable(file, header.m_parts, partRecords);
+    memcpy(file.data() + header.m_strings, strings.data().data(), strings.data().size());
+
+    header.m_checksum = checksum(file.data() + sizeof(SNAPSHOT_HEADER),
+                                 file.size() - sizeof(SNAPSHOT_HEADER));
+    memcpy(file.data(), &header, sizeof(header));
+
+    // write next to the target and rename, so no process ever maps a half written file
+#ifdef WIN32
+    std::string temp = path + ".tmp" + std::to_string(_getpid());
+#else
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+#endif
+
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out)
+        return false;
+
+    bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+    written = fclose(out) == 0 && written;
+
+#ifdef WIN32
+    written = written && MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    written = written && std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+
+    if (!written)
+        std::remove(temp.c_str());
+
+    return written;
+}
+
+std::string CATALOG_SNAPSHOT::serverURL() const {
+    return std::string(chars(m_header->m_serverURL), length(m_header->m_serverURL));
+}
+
+std::chrono::system_clock::time_point CATALOG_SNAPSHOT::created() const {
+    return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::seconds(m_header->m_created)));
+}
+
+const SNAPSHOT_TEMPLATE *CATALOG_SNAPSHOT::findTemplate(int pk) const {
+    return findRecord(m_templates, m_header->m_templateCount, pk);
+}
+
+const SNAPSHOT_LOCATION *CATALOG_SNAPSHOT::findLocation(int pk) const {
+    return findRecord(m_locations, m_header->m_locationCount, pk);
+}
+
+const SNAPSHOT_PART *CATALOG_SNAPSHOT::findPart(int pk) const {
+    return findRecord(m_parts, m_header->m_partCount, pk);
+}
+
+const char *CATALOG_SNAPSHOT::chars(const SNAPSHOT_STRING &str) const {
+    return length(str) ? m_strings + str.m_offset : "";
+}
+
+size_t CATALOG_SNAPSHOT::length(const SNAPSHOT_STRING &str) const {
+    // the checksum only protects against damage, not against a writer with a bug
+    if (uint64_t(str.m_offset) + str.m_length >= m_header->m_stringsSize)
+        return 0;
+
+    return str.m_length;
+}
+
+wxString CATALOG_SNAPSHOT::string(const SNAPSHOT_STRING &str) const {
+    return wxString::FromUTF8(chars(str), length(str));
+}
+
+std::vector<FOUND_PART> CATALOG_SNAPSHOT::searchParts(const std::string &term, int server,
+                                                      size_t limit) const {
+    std::vector<std::string> words = SEARCH_CACHE::words(term);
+    std::vector<FOUND_PART> found;
+
+    for (size_t i = 0; i < m_header->m_partCount; i++) {
+        const SNAPSHOT_PART &part = m_parts[i];
+        const char *text = chars(part.m_searchText);
+        const char *end = text + length(part.m_searchText);
+
+        bool matches = std::all_of(words.begin(), words.end(), [&](const std::string &word) {
+            return std::search(text, end, word.begin(), word.end()) != end;
+        });
+
+        if (!matches)
+            continue;
+
+        found.push_back(foundPart(part, server));
+
+        if (limit && found.size() >= limit)
+            break;
+    }
+
+    return found;
+}
+
+FOUND_PART CATALOG_SNAPSHOT::foundPart(const SNAPSHOT_PART &part, int server) const {
+    FOUND_PART found(part.m_pk, string(part.m_description),
+                     std::string(chars(part.m_image), length(part.m_image)), server);
+    found.m_IPN = string(part.m_IPN);
+    found.m_category = part.m_category;
+    found.m_searchText.assign(chars(part.m_searchText), length(part.m_searchText));
+
+    return found;
+}
+
+uint64_t CATALOG_SNAPSHOT::checksum(const unsigned char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
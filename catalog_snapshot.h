@@ -0,0 +1,203 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_CATALOG_SNAPSHOT_H
+#define INVENTREE_CATALOG_SNAPSHOT_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <wx/string.h>
+
+#include "search_cache.h"
+
+struct TEMPLATE_PARAMETER;
+struct STOCK_LOCATION;
+
+/**
+ * A string in the string table of a snapshot, UTF-8 and zero terminated
+ */
+struct SNAPSHOT_STRING {
+    uint32_t m_offset;
+    uint32_t m_length;
+};
+
+struct SNAPSHOT_TEMPLATE {
+    int32_t m_pk;
+    SNAPSHOT_STRING m_name;
+    SNAPSHOT_STRING m_units;
+};
+
+struct SNAPSHOT_LOCATION {
+    int32_t m_pk;
+    int32_t m_parent;
+    int32_t m_items;
+    SNAPSHOT_STRING m_url;
+    SNAPSHOT_STRING m_name;
+    SNAPSHOT_STRING m_description;
+    SNAPSHOT_STRING m_pathstring;
+};
+
+struct SNAPSHOT_PART {
+    int32_t m_pk;
+    int32_t m_category;
+    SNAPSHOT_STRING m_description;
+    SNAPSHOT_STRING m_IPN;
+    SNAPSHOT_STRING m_image;
+
+    // lower case searchable fields, see FOUND_PART::m_searchText
+    SNAPSHOT_STRING m_searchText;
+};
+
+/**
+ * Start of every snapshot file. Offsets are counted from the start of the file, the tables are
+ * sorted by pk
+ */
+struct SNAPSHOT_HEADER {
+    char m_magic[8];
+    uint32_t m_version;
+
+    // written as 0x01020304, a file from a machine with another byte order is rejected
+    uint32_t m_byteOrder;
+
+    uint64_t m_fileSize;
+
+    // FNV-1a of everything following the header
+    uint64_t m_checksum;
+
+    // seconds since the epoch
+    int64_t m_created;
+
+    uint32_t m_templateCount;
+    uint32_t m_templateSize;
+    uint32_t m_locationCount;
+    uint32_t m_locationSize;
+    uint32_t m_partCount;
+    uint32_t m_partSize;
+
+    uint64_t m_templates;
+    uint64_t m_locations;
+    uint64_t m_parts;
+    uint64_t m_strings;
+    uint64_t m_stringsSize;
+
+    // the server the data was loaded from
+    SNAPSHOT_STRING m_serverURL;
+};
+
+
+/*! A read-only, memory-mapped copy of the reference data (parameter templates, stock locations)
+ * and the part list of an InvenTree server. The file is used in place: records have a fixed
+ * layout, strings are offsets into a string table and records are found by pk with a binary
+ * search, so opening a snapshot costs a checksum pass instead of parsing JSON.
+ * Several processes, e.g. eeschema and pcbnew, map the same file and share its pages. A new
+ * snapshot is written next to the old one and renamed over it, processes which still map the old
+ * file keep using it.
+ * All methods are thread safe.
+ * */
+class CATALOG_SNAPSHOT {
+public:
+    ~CATALOG_SNAPSHOT();
+
+    /*!
+      Maps a snapshot file
+      @param[in] path file to map
+      @param[out] error why the file can not be used, if it is not nullptr
+      @return nullptr if the file is missing, has another version or byte order, is truncated or
+              its checksum does not match
+      */
+    static std::shared_ptr<const CATALOG_SNAPSHOT> open(const std::string &path,
+                                                        std::string *error = nullptr);
+
+    /*!
+      Writes a snapshot file, replacing an existing one as a whole
+      @param[in] path file to write
+      @param[in] serverURL server the data was loaded from
+      @return bool returns true if the file was written
+      */
+    static bool write(const std::string &path, const std::string &serverURL,
+                      const std::vector<TEMPLATE_PARAMETER> &templates,
+                      const std::vector<STOCK_LOCATION> &locations,
+                      const std::vector<FOUND_PART> &parts);
+
+    std::string serverURL() const;
+
+    std::chrono::system_clock::time_point created() const;
+
+    size_t templateCount() const { return m_header->m_templateCount; }
+
+    size_t locationCount() const { return m_header->m_locationCount; }
+
+    size_t partCount() const { return m_header->m_partCount; }
+
+    const SNAPSHOT_TEMPLATE &templateAt(size_t i) const { return m_templates[i]; }
+
+    // @return nullptr if there is no record with this pk
+    const SNAPSHOT_TEMPLATE *findTemplate(int pk) const;
+
+    const SNAPSHOT_LOCATION *findLocation(int pk) const;
+
+    const SNAPSHOT_PART *findPart(int pk) const;
+
+    wxString string(const SNAPSHOT_STRING &str) const;
+
+    /*!
+      Searches the parts like InvenTree does, a part matches if every word of the term is
+      contained in its name, IPN, description or keywords
+      @param[in] term search term as entered
+      @param[in] server index of the server the parts are listed for
+      @param[in] limit maximum number of parts returned, 0 returns all
+      */
+    std::vector<FOUND_PART> searchParts(const std::string &term, int server,
+                                        size_t limit = 0) const;
+
+    FOUND_PART foundPart(const SNAPSHOT_PART &part, int server) const;
+
+    static const uint32_t VERSION = 2;
+
+private:
+    CATALOG_SNAPSHOT() = default;
+
+    bool map(const std::string &path, std::string &error);
+
+    bool validate(std::string &error);
+
+    static uint64_t checksum(const unsigned char *data, size_t size);
+
+    const char *chars(const SNAPSHOT_STRING &str) const;
+
+    // 0 for strings outside of the string table
+    size_t length(const SNAPSHOT_STRING &str) const;
+
+    const unsigned char *m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+
+    const SNAPSHOT_HEADER *m_header = nullptr;
+    const SNAPSHOT_TEMPLATE *m_templates = nullptr;
+    const SNAPSHOT_LOCATION *m_locations = nullptr;
+    const SNAPSHOT_PART *m_parts = nullptr;
+    const char *m_strings = nullptr;
+};
+
+#endif //INVENTREE_CATALOG_SNAPSHOT_H
@@ -0,0 +1,71 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "driver_metrics.h"
+
+std::map<std::string, double> DRIVER_METRICS::snapshot() const {
+    std::map<std::string, double> values;
+
+    values["responses"] = m_responses.load();
+    values["compressed_responses"] = m_compressedResponses.load();
+    values["wire_bytes"] = m_wireBytes.load();
+    values["decoded_bytes"] = m_decodedBytes.load();
+    values["decode_ms"] = m_decodeMicros.load() / 1000.0;
+    values["compression_ratio"] = m_wireBytes.load()
+                                  ? static_cast<double>(m_decodedBytes.load()) / m_wireBytes.load()
+                                  : 0;
+
+    values["images"] = m_images.load();
+    values["image_wire_bytes"] = m_imageWireBytes.load();
+
+    values["retries"] = m_retries.load();
+    values["hedged_requests"] = m_hedgedRequests.load();
+    values["hedge_wins"] = m_hedgeWins.load();
+
+    values["search_cache_hits"] = m_searchCacheHits.load();
+    values["search_cache_misses"] = m_searchCacheMisses.load();
+
+    values["json_requests"] = m_jsonRequests.load();
+    values["coalesced_requests"] = m_coalescedRequests.load();
+    values["coalescing_rate"] = m_jsonRequests.load()
+                                ? static_cast<double>(m_coalescedRequests.load()) /
+                                  m_jsonRequests.load()
+                                : 0;
+
+    values["shared_reference_data"] = m_sharedReferenceData.load();
+
+    values["stock_polls"] = m_stockPolls.load();
+    values["stock_not_modified"] = m_stockNotModified.load();
+    values["stock_changes"] = m_stockChanges.load();
+
+    values["part_number_lookups"] = m_partNumberLookups.load();
+    values["part_number_hits"] = m_partNumberHits.load();
+
+    const char *lanes[] = {"interactive", "background"};
+
+    for (size_t lane = 0; lane < 2; lane++) {
+        std::string name = lanes[lane];
+        size_t dispatched = m_laneDispatched[lane].load();
+
+        values[name + "_queue_depth"] = m_laneQueued[lane].load();
+        values[name + "_peak_queue_depth"] = m_lanePeakQueued[lane].load();
+        values[name + "_dispatched"] = dispatched;
+        values[name + "_wait_ms"] = dispatched ? m_laneWaitMicros[lane].load() / 1000.0 / dispatched
+                                               : 0;
+    }
+
+    return values;
+}
@@ -0,0 +1,80 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_DRIVER_METRICS_H
+#define INVENTREE_DRIVER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <string>
+
+/**
+ * Counters describing the work done by one driver instance. All counters can be updated from any
+ * thread without locking.
+ */
+struct DRIVER_METRICS {
+    // API responses and their size before and after content decoding
+    std::atomic<size_t> m_responses{0};
+    std::atomic<size_t> m_compressedResponses{0};
+    std::atomic<size_t> m_wireBytes{0};
+    std::atomic<size_t> m_decodedBytes{0};
+    std::atomic<long long> m_decodeMicros{0};
+
+    // part images fetched by libcurl
+    std::atomic<size_t> m_images{0};
+    std::atomic<size_t> m_imageWireBytes{0};
+
+    std::atomic<size_t> m_retries{0};
+    std::atomic<size_t> m_hedgedRequests{0};
+    std::atomic<size_t> m_hedgeWins{0};
+
+    // searches answered from an earlier result set, or sent to a server
+    std::atomic<size_t> m_searchCacheHits{0};
+    std::atomic<size_t> m_searchCacheMisses{0};
+
+    // GET requests asked for, and how many of them shared an identical request in flight
+    std::atomic<size_t> m_jsonRequests{0};
+    std::atomic<size_t> m_coalescedRequests{0};
+
+    // connects which found the reference data loaded by another driver instance
+    std::atomic<size_t> m_sharedReferenceData{0};
+
+    // stock polls sent, answered with 304, and stock changes pushed to the callback (polled or
+    // received over a websocket)
+    std::atomic<size_t> m_stockPolls{0};
+    std::atomic<size_t> m_stockNotModified{0};
+    std::atomic<size_t> m_stockChanges{0};
+
+    // part number lookups, and how many of them found a part
+    std::atomic<size_t> m_partNumberLookups{0};
+    std::atomic<size_t> m_partNumberHits{0};
+
+    // executor lanes, 0 is interactive and 1 background: work and requests waiting for a thread
+    // or a request slot, the most that ever waited, how many were dispatched and their waiting time
+    std::array<std::atomic<long long>, 2> m_laneQueued{};
+    std::array<std::atomic<long long>, 2> m_lanePeakQueued{};
+    std::array<std::atomic<size_t>, 2> m_laneDispatched{};
+    std::array<std::atomic<long long>, 2> m_laneWaitMicros{};
+
+    /*!
+      Returns a consistent enough copy of all counters for reporting
+      @return counter name -> value
+      */
+    std::map<std::string, double> snapshot() const;
+};
+
+#endif //INVENTREE_DRIVER_METRICS_H
@@ -0,0 +1,232 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_HIERARCHY_INDEX_H
+#define INVENTREE_HIERARCHY_INDEX_H
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <wx/string.h>
+
+/*! An immutable tree of InvenTree objects which name their parent, e.g. part categories. The nodes
+ * are kept in depth first order, so the subtree of a node is the range of nodes following it and
+ * the question whether a node lies below another one is answered with two comparisons. The path
+ * of every node ("Passives/Resistors/SMD") is built once when the index is created.
+ *
+ * NODE needs the fields "int m_pk", "int m_parent" (-1 or an unknown pk for top level nodes) and
+ * "wxString m_name". Nodes whose parents form a cycle are placed at the top level.
+ * All methods are thread safe.
+ * */
+template<class NODE>
+class HIERARCHY_INDEX {
+public:
+    /*!
+      @param[in] nodes nodes in any order, siblings are sorted by name
+      @param[in] separator put between the names of a path
+      */
+    explicit HIERARCHY_INDEX(std::vector<NODE> nodes, const wxString &separator = "/") {
+        std::unordered_map<int, size_t> input;
+        for (size_t i = 0; i < nodes.size(); i++)
+            input.insert(std::make_pair(nodes[i].m_pk, i));
+
+        std::vector<std::vector<size_t>> children(nodes.size());
+        std::vector<size_t> roots;
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            auto parent = input.find(nodes[i].m_parent);
+
+            if (parent != input.end() && parent->second != i)
+                children[parent->second].push_back(i);
+            else
+                roots.push_back(i);
+        }
+
+        auto byName = [&nodes](size_t a, size_t b) {
+            return nodes[a].m_name.CmpNoCase(nodes[b].m_name) < 0;
+        };
+
+        std::sort(roots.begin(), roots.end(), byName);
+        for (auto &list : children)
+            std::sort(list.begin(), list.end(), byName);
+
+        std::vector<size_t> order;
+        std::vector<bool> visited(nodes.size(), false);
+        m_parents.resize(nodes.size(), -1);
+        m_subtreeEnd.resize(nodes.size(), 0);
+        m_paths.resize(nodes.size());
+
+        for (size_t top : roots)
+            walk(nodes, children, top, separator, order, visited);
+
+        // a node which is not reached from the top level is part of a cycle, it starts a tree of
+        // its own
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!visited[i])
+                walk(nodes, children, i, separator, order, visited);
+        }
+
+        m_nodes.reserve(order.size());
+        for (size_t i : order)
+            m_nodes.push_back(std::move(nodes[i]));
+
+        for (size_t pos = 0; pos < m_paths.size(); pos++)
+            m_pathIndex.insert(std::make_pair(m_paths[pos].Lower(), pos));
+    }
+
+    size_t size() const { return m_nodes.size(); }
+
+    // node at a position in depth first order
+    const NODE &at(size_t pos) const { return m_nodes[pos]; }
+
+    // all nodes in depth first order
+    const std::vector<NODE> &nodes() const { return m_nodes; }
+
+    // @return the position of a node in depth first order, -1 if there is no node with this pk
+    long position(int pk) const {
+        auto pos = m_positions.find(pk);
+        return pos != m_positions.end() ? static_cast<long>(pos->second) : -1;
+    }
+
+    // @return nullptr if there is no node with this pk
+    const NODE *find(int pk) const {
+        auto pos = m_positions.find(pk);
+        return pos != m_positions.end() ? &m_nodes[pos->second] : nullptr;
+    }
+
+    /*!
+      Looks up a node by its path, case insensitive
+      @return nullptr if no node has this path
+      */
+    const NODE *findPath(const wxString &path) const {
+        auto pos = m_pathIndex.find(path.Lower());
+        return pos != m_pathIndex.end() ? &m_nodes[pos->second] : nullptr;
+    }
+
+    // @return the names from the top level down to the node, empty for an unknown pk
+    wxString path(int pk) const {
+        auto pos = m_positions.find(pk);
+        return pos != m_positions.end() ? m_paths[pos->second] : wxString();
+    }
+
+    // paths of all nodes in depth first order
+    const std::vector<wxString> &paths() const { return m_paths; }
+
+    // @return true if the node is the ancestor itself or lies below it
+    bool contains(int ancestor, int pk) const {
+        auto top = m_positions.find(ancestor);
+        auto pos = m_positions.find(pk);
+
+        if (top == m_positions.end() || pos == m_positions.end())
+            return false;
+
+        return pos->second >= top->second && pos->second < m_subtreeEnd[top->second];
+    }
+
+    // @return the node and all nodes below it in depth first order, empty for an unknown pk
+    std::pair<const NODE *, const NODE *> subtree(int pk) const {
+        auto pos = m_positions.find(pk);
+        if (pos == m_positions.end())
+            return std::pair<const NODE *, const NODE *>(nullptr, nullptr);
+
+        return std::make_pair(m_nodes.data() + pos->second,
+                              m_nodes.data() + m_subtreeEnd[pos->second]);
+    }
+
+    // @return the nodes from the top level down to the node itself, empty for an unknown pk
+    std::vector<const NODE *> ancestors(int pk) const {
+        std::vector<const NODE *> chain;
+
+        auto pos = m_positions.find(pk);
+        if (pos == m_positions.end())
+            return chain;
+
+        for (long p = static_cast<long>(pos->second); p >= 0; p = m_parents[p])
+            chain.push_back(&m_nodes[p]);
+
+        std::reverse(chain.begin(), chain.end());
+        return chain;
+    }
+
+private:
+    // appends a node and the nodes below it to the depth first order
+    void walk(const std::vector<NODE> &nodes, const std::vector<std::vector<size_t>> &children,
+              size_t top, const wxString &separator, std::vector<size_t> &order,
+              std::vector<bool> &visited) {
+        struct FRAME {
+            size_t m_node;
+            size_t m_next;
+            size_t m_pos;
+        };
+
+        std::vector<FRAME> stack;
+        stack.push_back(FRAME{top, 0, enter(nodes, top, -1, separator, order, visited)});
+
+        while (!stack.empty()) {
+            FRAME &current = stack.back();
+
+            if (current.m_next < children[current.m_node].size()) {
+                size_t child = children[current.m_node][current.m_next++];
+                if (visited[child])
+                    continue;
+
+                long parent = static_cast<long>(current.m_pos);
+                stack.push_back(FRAME{child, 0, enter(nodes, child, parent, separator, order,
+                                                      visited)});
+            } else {
+                m_subtreeEnd[current.m_pos] = order.size();
+                stack.pop_back();
+            }
+        }
+    }
+
+    // @return the position of the node in depth first order
+    size_t enter(const std::vector<NODE> &nodes, size_t node, long parent,
+                 const wxString &separator, std::vector<size_t> &order,
+                 std::vector<bool> &visited) {
+        size_t pos = order.size();
+
+        visited[node] = true;
+        order.push_back(node);
+        m_positions.insert(std::make_pair(nodes[node].m_pk, pos));
+        m_parents[pos] = parent;
+        m_paths[pos] = parent >= 0 ? m_paths[parent] + separator + nodes[node].m_name
+                                   : nodes[node].m_name;
+
+        return pos;
+    }
+
+    std::vector<NODE> m_nodes;
+
+    // position of the parent of every node, -1 for top level nodes
+    std::vector<long> m_parents;
+
+    // position following the last node of every subtree
+    std::vector<size_t> m_subtreeEnd;
+
+    std::vector<wxString> m_paths;
+
+    // pk -> position
+    std::unordered_map<int, size_t> m_positions;
+
+    // lower case path -> position
+    std::map<wxString, size_t> m_pathIndex;
+};
+
+#endif //INVENTREE_HIERARCHY_INDEX_H
@@ -16,6 +16,15 @@
 
 #include "inventree.h"
 # include "IWareHouse.h"
+#include "logger.h"
+#include "traffic_capture.h"
+
+#include <algorithm>
+#include <set>
+#include <thread>
+
+// messages of a driver also go to its own status callback, on the thread which logs them
+#define DRIVER_LOG(level, expr) INVENTREE_LOG_STATUS(m_statusLog, level, expr)
 
 #if defined(__linux__) || defined(__APPLE__)
 extern "C"
@@ -45,12 +54,52 @@ extern "C"
 }
 #endif
 
-INVENTREE_DRIVER::INVENTREE_DRIVER() = default;
+INVENTREE_DRIVER::INVENTREE_DRIVER() {
+    // interactive requests get a tight budget, reference data may take longer on big catalogs
+    m_requestPolicies[_API_VERSION] = REQUEST_POLICY(5000, 1);
+    m_requestPolicies[_AUTH_TOKEN] = REQUEST_POLICY(10000, 1);
+    m_requestPolicies[_PART_SEARCH] = REQUEST_POLICY(10000, 2);
+    m_requestPolicies[_PART_DETAIL] = REQUEST_POLICY(5000, 2);
+    m_requestPolicies[_PART_PARAMETERS] = REQUEST_POLICY(5000, 2);
+    m_requestPolicies[_PART_IMAGE] = REQUEST_POLICY(5000, 0);
+    m_requestPolicies[_PARAMETER_TEMPLATES] = REQUEST_POLICY(60000, 3);
+    m_requestPolicies[_STOCK_LOCATIONS] = REQUEST_POLICY(60000, 3);
+    m_requestPolicies[_PART_CATEGORIES] = REQUEST_POLICY(60000, 3);
+
+    // creating objects is not idempotent, a lost response must not create a duplicate
+    m_requestPolicies[_CREATE] = REQUEST_POLICY(10000, 0);
+
+    // the complete part list for a snapshot, loaded in the background
+    m_requestPolicies[_CATALOG] = REQUEST_POLICY(120000, 2);
+
+    // a lost stock poll is simply repeated by the next one
+    m_requestPolicies[_STOCK] = REQUEST_POLICY(5000, 0);
+
+    // all parts and parameters for the database library, loaded in the background
+    m_requestPolicies[_LIBRARY] = m_requestPolicies[_CATALOG];
+
+    // all part, manufacturer and supplier part numbers, loaded in the background
+    m_requestPolicies[_PART_NUMBERS] = m_requestPolicies[_CATALOG];
+}
+
+INVENTREE_DRIVER::~INVENTREE_DRIVER() {
+    stopStockWatch();
 
-INVENTREE_DRIVER::~INVENTREE_DRIVER() = default;
+    waitForPendingRequests();
+}
 
 bool INVENTREE_DRIVER::connectToWarehouse(std::map<wxString, wxString> args, int driverID) {
-    std::cout << "connectToWarehouse" << std::endl;
+    std::unique_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+
+    // the watched parts refer to the servers which are replaced now
+    stopStockWatch();
+
+    // requests of earlier calls which are still retrying or hedging read the configuration
+    waitForPendingRequests();
+
+    configureLogger(args);
+
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "connectToWarehouse");
 
     // save assigned driver ID, this ID is assigned randomly by the caller
     m_driverID = driverID;
@@ -65,66 +114,717 @@ bool INVENTREE_DRIVER::connectToWarehouse(std::map<wxString, wxString> args, int
         return false;
     }
 
-    // construct server url
-    m_ServerURL = wxString::Format("%s:%s", args["server_url"], args["server_port"]).ToStdString();
-    m_ApiURL = m_ServerURL + "/api/";
+    if (!configureTrafficCapture(args))
+        return false;
+
+    configureRequestPolicies(args);
+
+    configureFieldProjection(args);
+
+    configureSearchCache(args);
+
+    configurePartCreation(args);
+
+    configureSnapshots(args);
+
+    configureExecutor(args);
+
+    configureStockWatch(args);
+
+    configureLibrary(args);
+
+    configurePartNumbers(args);
+
+    // positions of earlier search results refer to the servers which are replaced now
+    std::atomic_store(&m_foundParts, std::make_shared<const std::vector<FOUND_PART>>());
+    m_servers.clear();
+
+    std::vector<SERVER_PTR> servers = configureServers(args);
+
+    // connect to all servers at once, a slow server only delays its own connection
+    std::vector<pplx::task<bool>> connecting;
+    for (const auto &server : servers) {
+        connecting.push_back(pplx::create_task([this, server]() {
+            return connectServer(server);
+        }));
+    }
+
+    for (size_t i = 0; i < servers.size(); i++) {
+        if (connecting[i].get())
+            m_servers.push_back(servers[i]);
+        else
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                       "Failed to connect to " << servers[i]->m_serverURL);
+    }
+
+    startStockWatch();
+
+    if (!m_libraryFile.empty() && !m_servers.empty())
+        refreshLibrary();
+
+    if (m_partNumberIndex)
+        refreshPartNumbers();
+
+    return !m_servers.empty();
+}
+
+std::vector<INVENTREE_DRIVER::SERVER_PTR> INVENTREE_DRIVER::configureServers(
+        std::map<wxString, wxString> &args) {
+    std::vector<SERVER_PTR> servers;
+
+    // the first server may be given with or without index (".0"), the others are numbered from 1
+    for (int i = 0;; i++) {
+        wxString suffix = wxString::Format(".%d", i);
+
+        if (i == 0) {
+            auto url = args.find("server_url");
+            if (url != args.end() && !url->second.empty())
+                suffix = wxString();
+        }
+
+        if (!args.count("server_url" + suffix) || args["server_url" + suffix].empty()) {
+            if (i == 0)
+                continue;
+            break;
+        }
+
+        // settings of other servers default to those of the first one
+        auto value = [&](const wxString &name) {
+            for (const wxString &key : {name + suffix, name, name + ".0"}) {
+                auto v = args.find(key);
+                if (v != args.end() && !v->second.empty())
+                    return v->second;
+            }
+
+            return wxString();
+        };
+
+        SERVER_PTR server = std::make_shared<SERVER_CONNECTION>();
+
+        // construct server url
+        server->m_serverURL = wxString::Format("%s:%s", args["server_url" + suffix],
+                                               value("server_port")).ToStdString();
+        server->m_apiURL = server->m_serverURL + "/api/";
+
+        server->m_username = value("username").ToStdString();
+        server->m_password = value("password").ToStdString();
+
+        // other instances connected to the same server share their templates and locations
+        server->m_reference = referenceRegistry().attach(server->m_serverURL + " " +
+                                                         server->m_username);
+
+        // every server needs a file of its own, so there is no fallback to the first one
+        if (args.count("snapshot_file" + suffix))
+            server->m_snapshotFile = args["snapshot_file" + suffix].ToStdString();
+
+        if (args.count("stock_websocket_url" + suffix))
+            server->m_stockWebsocketURL = args["stock_websocket_url" + suffix].ToStdString();
+
+        // without an explicit tag the results are labeled with the host name
+        server->m_tag = args.count("server_tag" + suffix) ? args["server_tag" + suffix]
+                                                           : wxString();
+        if (server->m_tag.empty())
+            server->m_tag = args["server_url" + suffix].AfterLast('/');
+
+        servers.push_back(server);
+    }
+
+    return servers;
+}
+
+bool INVENTREE_DRIVER::connectServer(const SERVER_PTR &server) {
+    // the snapshot of an earlier session replaces the download of the reference data
+    std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = openSnapshot(server);
+    std::atomic_store(&server->m_snapshot, snapshot);
+
+    getInvenTreeVersion(server);
 
     // request auth token from warehouse API
-    wxString username = args["username"];
-    wxString password = args["password"];
+    getAuthToken(server);
+
+    if (server->m_apiToken.empty()) {
+        // searches are answered from the snapshot until the server can be reached again
+        server->m_offline = snapshot != nullptr;
+
+        if (server->m_offline)
+            DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                       server->m_serverURL << " can not be reached, using its snapshot");
+
+        return server->m_offline;
+    }
+
+    if (!snapshot) {
+        loadReferenceData(server);
+
+        if (!server->m_snapshotFile.empty())
+            refreshSnapshot(server);
+    } else {
+        // the snapshot does not keep the category tree
+        loadReferenceData(server, true);
+
+        if (std::chrono::system_clock::now() - snapshot->created() > m_snapshotMaxAge)
+            refreshSnapshot(server);
+    }
+
+    return true;
+}
+
+bool INVENTREE_DRIVER::loadReferenceData(const SERVER_PTR &server, bool categoriesOnly) {
+    REFERENCE_DATA &reference = *server->m_reference;
+    std::lock_guard<std::mutex> lock(reference.m_loadMutex);
+
+    if (reference.m_categoriesLoaded && (reference.m_loaded || categoriesOnly)) {
+        m_metrics.m_sharedReferenceData++;
+
+        DRIVER_LOG(INVENTREE_LOGGER::_DEBUG,
+                   "Reference data of " << server->m_serverURL << " is already loaded");
+        return true;
+    }
+
+    // a failed load is tried again by the next instance which connects
+    if (!reference.m_categoriesLoaded)
+        reference.m_categoriesLoaded = getAllPartCategories(server) != nullptr;
+
+    if (!reference.m_loaded && !categoriesOnly) {
+        bool templates = getAllParameterTemplates(server) != nullptr;
+        bool locations = getAllStockLocations(server) != nullptr;
+
+        reference.m_loaded = templates && locations;
+    }
+
+    return reference.m_categoriesLoaded && (reference.m_loaded || categoriesOnly);
+}
+
+SHARED_REGISTRY<REFERENCE_DATA> &INVENTREE_DRIVER::referenceRegistry() {
+    static SHARED_REGISTRY<REFERENCE_DATA> registry;
+    return registry;
+}
+
+std::shared_ptr<const CATALOG_SNAPSHOT> INVENTREE_DRIVER::openSnapshot(const SERVER_PTR &server) {
+    if (server->m_snapshotFile.empty())
+        return nullptr;
+
+    std::string error;
+    std::shared_ptr<const CATALOG_SNAPSHOT> snapshot =
+            CATALOG_SNAPSHOT::open(server->m_snapshotFile, &error);
+
+    if (!snapshot) {
+        // a missing or damaged snapshot is replaced once the server has been reached
+        DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                   "Snapshot " << server->m_snapshotFile << " not used: " << error);
+        return nullptr;
+    }
+
+    if (snapshot->serverURL() != server->m_serverURL) {
+        DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                   "Snapshot " << server->m_snapshotFile << " belongs to "
+                               << snapshot->serverURL());
+        return nullptr;
+    }
+
+    DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+               "Snapshot " << server->m_snapshotFile << ": " << snapshot->templateCount()
+                           << " template(s), " << snapshot->locationCount()
+                           << " location(s), " << snapshot->partCount() << " part(s)");
+
+    return snapshot;
+}
+
+bool INVENTREE_DRIVER::writeSnapshot(const SERVER_PTR &server) {
+    // reference data loaded by this session is current, it does not have to be loaded again
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> templates =
+            std::atomic_load(&server->m_reference->m_parameterTemplates);
+    if (templates->empty())
+        templates = getAllParameterTemplates(server, false);
+
+    std::shared_ptr<const STOCK_LOCATION_INDEX> locations =
+            std::atomic_load(&server->m_reference->m_stockLocations);
+    if (locations->size() == 0)
+        locations = getAllStockLocations(server, false);
+
+    bool complete = false;
+    std::vector<FOUND_PART> parts = getAllParts(server, complete);
+
+    // an incomplete snapshot would hide parts from offline searches
+    if (!templates || !locations || !complete) {
+        DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                   "Snapshot of " << server->m_serverURL << " not written, loading failed");
+        return false;
+    }
+
+    if (!CATALOG_SNAPSHOT::write(server->m_snapshotFile, server->m_serverURL, *templates,
+                                 locations->nodes(), parts)) {
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                   "Failed to write snapshot " << server->m_snapshotFile);
+        return false;
+    }
+
+    std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = openSnapshot(server);
+    if (!snapshot)
+        return false;
+
+    std::atomic_store(&server->m_snapshot, snapshot);
+    return true;
+}
+
+void INVENTREE_DRIVER::refreshSnapshot(const SERVER_PTR &server) {
+    // the driver waits for the refresh before it is reconfigured or destroyed
+    beginRequest();
+
+    pplx::create_task([this, server]() {
+        writeSnapshot(server);
+    }).then([this](pplx::task<void> refresh) {
+        try {
+            refresh.get();
+        }
+        catch (std::exception const &e) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "refreshSnapshot(): " << e.what());
+        }
+
+        endRequest();
+    });
+}
+
+std::vector<FOUND_PART> INVENTREE_DRIVER::getAllParts(const SERVER_PTR &server, bool &complete) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getAllParts");
+
+    std::vector<FOUND_PART> parts;
+    complete = false;
+
+    getJSONRequest(server, _CATALOG, server->m_apiURL + "part/")
+            .then([=, &parts, &complete](pplx::task<json::value> jsonResponse) {
+                try {
+                    json::value obj = evaluateJSONResponse(std::move(jsonResponse));
+
+                    if (!obj.is_null())
+                        parts = parseFoundParts(obj, 0, complete);
+                }
+                catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getAllParts(): " << e.what());
+                }
+            })
+            .wait();
+
+    return parts;
+}
+
+long INVENTREE_DRIVER::exportDatabaseLibrary(const std::string &path,
+                                             const std::string &descriptionPath) {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+
+    return writeLibrary(m_servers, path, descriptionPath);
+}
+
+void INVENTREE_DRIVER::refreshLibrary() {
+    // the driver waits for the refresh before it is reconfigured or destroyed, so the refresh
+    // must not wait for the connection lock
+    beginRequest();
+
+    std::vector<SERVER_PTR> servers = m_servers;
+    std::string path = m_libraryFile;
+    std::string descriptionPath = m_libraryDescriptionFile;
+
+    pplx::create_task([this, servers, path, descriptionPath]() {
+        writeLibrary(servers, path, descriptionPath);
+    }).then([this](pplx::task<void> refresh) {
+        try {
+            refresh.get();
+        }
+        catch (std::exception const &e) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "refreshLibrary(): " << e.what());
+        }
+
+        endRequest();
+    });
+}
 
-    getInvenTreeVersion();
+std::vector<std::pair<int, int>> INVENTREE_DRIVER::findPartsByNumber(const wxString &number) {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
 
-    getAuthToken(username.ToStdString(), password.ToStdString());
+    std::vector<std::pair<int, int>> parts =
+            m_partNumbers.lookup(std::string(number.utf8_str()));
 
-    if (m_apiToken.empty()) {
+    m_metrics.m_partNumberLookups++;
+    if (!parts.empty())
+        m_metrics.m_partNumberHits++;
+
+    return parts;
+}
+
+void INVENTREE_DRIVER::refreshPartNumbers() {
+    for (size_t idx = 0; idx < m_servers.size(); idx++) {
+        SERVER_PTR server = m_servers[idx];
+        int serverIdx = static_cast<int>(idx);
+
+        // only a live server knows its manufacturer and supplier parts
+        if (server->m_offline)
+            continue;
+
+        // the driver waits for the refresh before it is reconfigured or destroyed, so the refresh
+        // must not wait for the connection lock
+        beginRequest();
+
+        // parts created while the lists are loaded may be missing from them
+        m_partNumbers.beginLoad(serverIdx);
+
+        pplx::create_task([this, server, serverIdx]() {
+            PART_NUMBER_INDEX::TABLE table;
+
+            if (loadPartNumbers(server, table)) {
+                DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                           server->m_tag << ": " << table.size() << " part number(s) indexed");
+                m_partNumbers.replace(serverIdx, std::move(table));
+            } else {
+                m_partNumbers.cancelLoad(serverIdx);
+            }
+        }).then([this, serverIdx](pplx::task<void> refresh) {
+            try {
+                refresh.get();
+            }
+            catch (std::exception const &e) {
+                m_partNumbers.cancelLoad(serverIdx);
+                DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "refreshPartNumbers(): " << e.what());
+            }
+
+            endRequest();
+        });
+    }
+}
+
+bool INVENTREE_DRIVER::loadPartNumbers(const SERVER_PTR &server, PART_NUMBER_INDEX::TABLE &table) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "loadPartNumbers");
+
+    // all three lists are loaded at once
+    const char *lists[] = {"part/", "company/part/manufacturer/", "company/part/"};
+    std::vector<pplx::task<json::value>> requests;
+
+    for (const char *list : lists)
+        requests.push_back(getJSONRequest(server, _PART_NUMBERS, server->m_apiURL + list));
+
+    bool partsLoaded = false;
+
+    // every request is waited for, none of them may outlive the refresh
+    for (size_t i = 0; i < requests.size(); i++) {
+        json::value obj;
+
+        try {
+            obj = evaluateJSONResponse(requests[i]);
+        }
+        catch (http_exception const &e) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "loadPartNumbers(): " << e.what());
+        }
+
+        if (!obj.is_array()) {
+            DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                       server->m_tag << ": " << lists[i] << " not indexed");
+            continue;
+        }
+
+        partsLoaded = partsLoaded || i == 0;
+
+        // a part carries its IPN, manufacturer and supplier parts point to their part
+        const utility::string_t partField = i == 0 ? U("pk") : U("part");
+
+        for (const auto &entry : obj.as_array()) {
+            if (!entry.has_field(partField) || !entry.at(partField).is_integer())
+                continue;
+
+            int pk = entry.at(partField).as_integer();
+
+            for (const auto &field : {U("IPN"), U("MPN"), U("SKU")}) {
+                wxString number = stringField(entry, field);
+
+                if (!number.empty())
+                    PART_NUMBER_INDEX::add(table, std::string(number.utf8_str()), pk);
+            }
+        }
+    }
+
+    // without the IPNs the index would be misleading, servers without the company app only
+    // lack manufacturer and supplier part numbers
+    return partsLoaded;
+}
+
+long INVENTREE_DRIVER::writeLibrary(const std::vector<SERVER_PTR> &servers,
+                                    const std::string &path,
+                                    const std::string &descriptionPath) {
+#ifdef INVENTREE_WITH_SQLITE
+    SQLITE_LIBRARY library;
+    std::string error;
+
+    if (!library.open(path, &error)) {
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                   "Database library " << path << " can not be opened: " << error);
+        return -1;
+    }
+
+    long total = 0;
+
+    for (const auto &server : servers) {
+        if (server->m_offline)
+            continue;
+
+        std::vector<std::string> parameters;
+        std::vector<LIBRARY_ROW> rows;
+
+        // parts missing from an incomplete list would be deleted
+        if (!loadLibraryRows(server, parameters, rows)) {
+            DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                       "Database library: parts of " << server->m_serverURL
+                                                     << " not updated, loading failed");
+            continue;
+        }
+
+        size_t written = 0;
+        size_t deleted = 0;
+
+        if (!library.update(server->m_serverURL, parameters, rows, written, deleted)) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                       "Database library " << path << ": " << library.error());
+            return -1;
+        }
+
+        DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                   "Database library " << path << ": " << rows.size() << " part(s) of "
+                                       << server->m_serverURL << ", " << written
+                                       << " written, " << deleted << " deleted");
+
+        total += static_cast<long>(written);
+    }
+
+    if (!descriptionPath.empty() && !library.writeLibraryDescription(descriptionPath,
+                                                                     m_libraryName)) {
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                   "Failed to write library description " << descriptionPath);
+        return -1;
+    }
+
+    return total;
+#else
+    (void) servers;
+    (void) descriptionPath;
+
+    DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+               "Database library " << path << " not written, built without SQLite");
+    return -1;
+#endif
+}
+
+bool INVENTREE_DRIVER::loadLibraryRows(const SERVER_PTR &server,
+                                       std::vector<std::string> &parameters,
+                                       std::vector<LIBRARY_ROW> &rows) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "loadLibraryRows");
+
+    // both lists are loaded at once
+    pplx::task<json::value> partList = getJSONRequest(server, _LIBRARY,
+                                                      server->m_apiURL + "part/");
+    pplx::task<json::value> parameterList = getJSONRequest(server, _LIBRARY,
+                                                           server->m_apiURL + "part/parameter/");
+
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> templates =
+            std::atomic_load(&server->m_reference->m_parameterTemplates);
+    if (templates->empty())
+        templates = getAllParameterTemplates(server, false);
+
+    std::shared_ptr<const STOCK_LOCATION_INDEX> locations =
+            std::atomic_load(&server->m_reference->m_stockLocations);
+    if (locations->size() == 0)
+        locations = getAllStockLocations(server, false);
+
+    std::shared_ptr<const CATEGORY_INDEX> categories =
+            std::atomic_load(&server->m_reference->m_partCategories);
+    if (categories->size() == 0)
+        categories = getAllPartCategories(server, false);
+
+    json::value parts;
+    json::value partParameters;
+
+    try {
+        parts = evaluateJSONResponse(partList);
+        partParameters = evaluateJSONResponse(parameterList);
+    }
+    catch (http_exception const &e) {
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "loadLibraryRows(): " << e.what());
+        return false;
+    }
+
+    if (!templates || !locations || !categories || !parts.is_array() ||
+        !partParameters.is_array())
         return false;
+
+    // template pk -> name and units
+    std::map<int, const TEMPLATE_PARAMETER *> templateIndex;
+    for (const auto &t : *templates) {
+        templateIndex[t.m_pk] = &t;
+
+        // symbol and footprint have columns of their own
+        wxString key = normalizeKey(t.m_name);
+        if (key != "symbol" && key != "footprint")
+            parameters.emplace_back(t.m_name.utf8_str());
+    }
+
+    std::map<int, size_t> rowIndex;
+
+    for (const auto &part : parts.as_array()) {
+        if (!part.has_field(U("pk")) || !part.at(U("pk")).is_integer())
+            continue;
+
+        LIBRARY_ROW row;
+        row.m_pk = part.at(U("pk")).as_integer();
+
+        auto field = [&](const utility::string_t &name) {
+            return std::string(stringField(part, name).utf8_str());
+        };
+
+        row.m_values["id"] = std::string(server->m_tag.utf8_str()) + "-" +
+                             std::to_string(row.m_pk);
+        row.m_values["name"] = field(U("name"));
+        row.m_values["IPN"] = field(U("IPN"));
+        row.m_values["description"] = field(U("description"));
+        row.m_values["keywords"] = field(U("keywords"));
+
+        // the category path, e.g. "Passives/Resistors", groups the parts in KiCad
+        wxString category = categories->path(atoi(field(U("category")).c_str()));
+        row.m_values["category"] = category.empty() ? field(U("category"))
+                                                    : std::string(category.utf8_str());
+
+        row.m_values["in_stock"] = field(U("in_stock"));
+        row.m_values["units"] = field(U("units"));
+        row.m_values["datasheet"] = field(U("link"));
+
+        std::string image = field(U("image"));
+        if (!image.empty())
+            row.m_values["image"] = server->m_serverURL + image;
+
+        wxString location = locations->path(atoi(field(U("default_location")).c_str()));
+        if (!location.empty())
+            row.m_values["location"] = std::string(location.utf8_str());
+
+        rowIndex[row.m_pk] = rows.size();
+        rows.push_back(std::move(row));
+    }
+
+    for (const auto &parameter : partParameters.as_array()) {
+        if (!parameter.has_field(U("part")) || !parameter.at(U("part")).is_integer() ||
+            !parameter.has_field(U("template")) || !parameter.at(U("template")).is_integer())
+            continue;
+
+        auto row = rowIndex.find(parameter.at(U("part")).as_integer());
+        auto t = templateIndex.find(parameter.at(U("template")).as_integer());
+
+        if (row == rowIndex.end() || t == templateIndex.end())
+            continue;
+
+        LIBRARY_ROW &libraryRow = rows[row->second];
+        std::string data = std::string(stringField(parameter, U("data")).utf8_str());
+        wxString key = normalizeKey(t->second->m_name);
+
+        if (key == "symbol" || key == "footprint") {
+            libraryRow.m_values[std::string(key.utf8_str())] = data;
+            continue;
+        }
+
+        // like the part details, e.g. "10 kOhm"
+        if (!t->second->m_units.empty() && !data.empty())
+            data += " " + std::string(t->second->m_units.utf8_str());
+
+        libraryRow.m_parameters[std::string(t->second->m_name.utf8_str())] = data;
     }
 
     return true;
 }
 
 void INVENTREE_DRIVER::getSelectedPartParameters(int listPos) {
-    std::map<wxString, wxString> attributes;
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+
+    // the position refers to the most recent search, even if another thread searches meanwhile
+    std::shared_ptr<const std::vector<FOUND_PART>> foundParts = std::atomic_load(&m_foundParts);
+
+    if (listPos < 0 || listPos >= static_cast<int>(foundParts->size())) {
+        DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                   "getSelectedPartParameters(): no part at position " << listPos);
+        return;
+    }
+
+    const FOUND_PART &part = (*foundParts)[listPos];
+
+    if (part.m_server < 0 || part.m_server >= static_cast<int>(m_servers.size()))
+        return;
+
+    const SERVER_PTR &server = m_servers[part.m_server];
 
-    // Create iterator pointing to first element of list
-    auto it = m_foundParts.begin();
+    if (server->m_offline) {
+        // only what the snapshot keeps of the part can be shown
+        std::map<wxString, wxString> params;
+        params[formatNameString("description")] = part.m_description;
+        params[formatNameString("pk")] = wxString::Format("%d", part.m_pk);
+
+        if (!part.m_IPN.empty())
+            params["IPN"] = part.m_IPN;
 
-    // Advance the iterator by listPos positions,
-    std::advance(it, listPos);
+        wxString category =
+                std::atomic_load(&server->m_reference->m_partCategories)->path(part.m_category);
+        if (!category.empty())
+            params[formatNameString("category")] = category;
 
-    // Now iterator it points to listPos element -> assign to a new variable
-    json::value part = *it;
+        fCallbackDisplayPartParameters(params, m_driverID);
+        return;
+    }
 
     try {
-        int pk = part[U("pk")].as_integer();
+        int pk = part.m_pk;
 
         // query attributes and parameters
-        getPartAttributes(pk);
-        getPartParameters(pk);
+        std::vector<PART_ATTRIBUTE> attributes = getPartAttributes(server, pk);
+        std::vector<PART_PARAMETER> parameters = getPartParameters(server, pk);
 
-        // download image from inventree
-        if (!downloadImagesFile(m_ServerURL + part[U("image")].as_string())) {
-            std::cout << "!! Failed to download file:";
-        } else {
-            std::cout << "Load images from file..." << std::endl;
+        // download image from inventree, captured traffic does not contain images
+        if (m_trafficMode == _TRAFFIC_REPLAY) {
+            DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "Replaying traffic, image download skipped");
+        } else if (!part.m_image.empty()) {
+            size_t wireBytes = 0;
+
+            // the image counts against the requests running against the server
+            m_executor.acquire(server->m_serverURL, REQUEST_EXECUTOR::_INTERACTIVE).wait();
+
+            bool downloaded = downloadImagesFile(server->m_serverURL + part.m_image,
+                                                 m_requestPolicies[_PART_IMAGE].m_deadline.count(),
+                                                 &wireBytes);
+
+            m_executor.release(server->m_serverURL);
+
+            if (!downloaded) {
+                DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                           "Failed to download image of part " << pk);
+            } else {
+                DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "Load images from file...");
+            }
+
+            m_metrics.m_images++;
+            m_metrics.m_imageWireBytes += wireBytes;
         }
 
         // map received data in vector
         std::map<wxString, wxString> params;
-        for (const auto &p : m_partParameters) {
+        for (const auto &p : parameters) {
             params[formatNameString(p.m_template)] = p.m_data + " " + p.m_units;
         }
 
-        for (const auto &a : m_partAttributes) {
-            if (visibleAttributes(a.m_name))
+        for (const auto &a : attributes) {
+            // the location stock is derived from the default location, which is visible
+            if (visibleAttributes(a.m_name) || a.m_name == "location_stock")
                 params[formatNameString(a.m_name)] = a.m_value;
+
+            // changes of the stock shown are pushed from now on
+            if (a.m_name == "in_stock")
+                m_stockWatch.watch(part.m_server, pk, a.m_value);
         }
 
         fCallbackDisplayPartParameters(params, m_driverID);
     }
     catch (...) {
-        std::cout << "Error occurred" << std::endl;
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                   "getSelectedPartParameters(): failed to load part at position " << listPos);
     }
 }
 
@@ -140,40 +840,33 @@ std::vector<IWareHouse::WareHouseOptions> INVENTREE_DRIVER::wareHouseOptions() {
 }
 
 std::map<wxString, std::vector<wxString>> INVENTREE_DRIVER::Filters() {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
 
-    // TODO: This is just a mockup and needs to be coded properly
     std::map<wxString, std::vector<wxString>> filters;
 
-    std::vector<wxString> values = {"value_1", "value_2", "value_3", "value_4", "value_5", "value_6"};
+    // category paths of all servers, each listed once, a search in one of them is started with
+    // searchWareHouseForPartsInCategory(...)
+    std::vector<wxString> &paths = filters["Category"];
+    std::set<wxString> listed;
 
-    filters["filter1"] = values;
-    filters["filter2"] = values;
-    filters["filter3"] = values;
-    filters["filter4"] = values;
-    filters["filter5"] = values;
-    filters["filter6"] = values;
-    filters["filter7"] = values;
+    for (const auto &server : m_servers) {
+        std::shared_ptr<const CATEGORY_INDEX> categories =
+                std::atomic_load(&server->m_reference->m_partCategories);
 
-    return filters;
+        for (const auto &path : categories->paths()) {
+            if (listed.insert(path.Lower()).second)
+                paths.push_back(path);
+        }
+    }
 
+    return filters;
 }
 
 /***** Inventree HTTP requests ********/
-void INVENTREE_DRIVER::getInvenTreeVersion() {
-    std::cout << "getInvenTreeVersion" << std::endl;
-
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-
-    // create http client
-    http_client client(m_ApiURL);
+void INVENTREE_DRIVER::getInvenTreeVersion(const SERVER_PTR &server) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getInvenTreeVersion");
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
+    getJSONRequest(server, _API_VERSION, server->m_apiURL)
             .then([=](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
@@ -182,11 +875,14 @@ void INVENTREE_DRIVER::getInvenTreeVersion() {
                     if (!obj.is_null()) {
                         // add new results to vector
                         for (auto &attr : obj.as_object()) {
-                            APIVersion[attr.first] = removeQuotationMarks(attr.second.serialize());
+                            server->m_apiVersion[attr.first] =
+                                    removeQuotationMarks(attr.second.serialize());
                         }
                     }
                 }
                 catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getInvenTreeVersion(): " << e.what());
+
 //                    fCallbackDisplayStatusMessage(e.what(), "getInvenTreeVersion()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
                 }
@@ -194,50 +890,32 @@ void INVENTREE_DRIVER::getInvenTreeVersion() {
             .wait();
 }
 
-void INVENTREE_DRIVER::getAuthToken(const std::string &username, const std::string &password) {
-    web::credentials cred(username, password); // WinHTTP requires non-empty password
-
-    std::cout << "getAuthToken" << std::endl;
-
-    http_client_config client_config;
-    client_config.set_credentials(cred);
-
-    // create http client with base url
-    http_client client(m_ApiURL + "user/token/", client_config);
-
-    // add request type
-    web::http::http_request req(methods::GET);
-
-    // create request, and add header information
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
+void INVENTREE_DRIVER::getAuthToken(const SERVER_PTR &server) {
+    // WinHTTP requires non-empty password
+    web::credentials cred(server->m_username, server->m_password);
 
-    client.request(req)
-            .then([=](http_response response) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getAuthToken");
 
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
+    getJSONRequest(server, _AUTH_TOKEN, server->m_apiURL + "user/token/", "", cred)
             .then([=](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
                     json::value obj = evaluateJSONResponse(std::move(jsonResponse));
 
                     if (obj.size()) {
-                        m_apiToken = obj[U("token")].as_string();
-
-                        getAllParameterTemplates();
-
-                        getAllStockLocations();
+                        server->m_apiToken = obj[U("token")].as_string();
 
 //                        fCallbackDisplayStatusMessage("Connected to InvenTree as: " + username,
-//                                                      "Version: " + APIVersion["version"],
+//                                                      "Version: " + server->m_apiVersion["version"],
 //                                                      IWareHouse::Display::_STATUS_BAR);
 
                     } else {
-                        std::cout << "Empty token response..." << std::endl;
+                        DRIVER_LOG(INVENTREE_LOGGER::_WARNING, "Empty token response...");
                     }
                 }
                 catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getAuthToken(): " << e.what());
+
 //                    fCallbackDisplayStatusMessage(e.what(), "Server Message",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
                 }
@@ -247,70 +925,253 @@ void INVENTREE_DRIVER::getAuthToken(const std::string &username, const std::stri
 }
 
 void INVENTREE_DRIVER::searchWareHouseForParts(std::string searchTerm) {
-    std::cout << "searchWareHouseForParts" << std::endl;
+    searchWareHouseForPartsInCategory(std::move(searchTerm), wxString());
+}
 
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-    req.headers().add("Authorization", "Token " + m_apiToken);
-    req.set_request_uri("?search=" + uri::encode_data_string(searchTerm));
+void INVENTREE_DRIVER::searchWareHouseForPartsInCategory(std::string searchTerm,
+                                                         const wxString &category) {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
 
-    // create http client
-    http_client client(m_ApiURL + "part/");
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "searchWareHouseForParts");
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
-            .then([=](pplx::task<json::value> jsonResponse) {
-                try {
-                    // evaluate JSON response
-                    json::value obj = evaluateJSONResponse(std::move(jsonResponse));
+    auto merged = std::make_shared<MERGED_SEARCH>();
+    std::vector<pplx::task<void>> searches;
 
-                    //empty vector to save new results
-                    m_foundParts.clear();
-                    std::vector<wxString> foundParts;
+    std::string query = "?search=" + uri::encode_data_string(searchTerm);
+    if (m_searchLimit > 0)
+        query += "&limit=" + std::to_string(m_searchLimit);
 
-                    if (!obj.is_null()) {
-                        // add new results to vector
-                        for (auto &part : obj.as_array()) {
-                            m_foundParts.emplace_back(part);
-                            foundParts.emplace_back(part.at(U("description")).as_string());
-                        }
-                    }
+    for (size_t idx = 0; idx < m_servers.size(); idx++) {
+        const SERVER_PTR &server = m_servers[idx];
+        int serverIdx = static_cast<int>(idx);
+        std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = std::atomic_load(&server->m_snapshot);
+        std::shared_ptr<const CATEGORY_INDEX> categories =
+                std::atomic_load(&server->m_reference->m_partCategories);
 
-                    fCallbackDisplayFoundParts(foundParts, m_driverID);
+        // the category has another pk on every server, it is found by its path
+        int scope = -1;
+        std::string serverQuery = query;
+
+        if (!category.empty() && categories->size() > 0) {
+            const PART_CATEGORY *top = categories->findPath(category);
+
+            // no part of this server can match
+            if (!top)
+                continue;
+
+            scope = top->m_pk;
+            serverQuery += "&category=" + std::to_string(scope) + "&cascade=1";
+        } else if (!category.empty()) {
+            DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                       server->m_tag << ": categories not loaded, searching all parts");
+        }
+
+        // the limit applies to the parts within the category
+        auto searchSnapshot = [=]() {
+            std::vector<FOUND_PART> parts =
+                    snapshot->searchParts(searchTerm, serverIdx, scope < 0 ? m_searchLimit : 0);
+            scopeToCategory(parts, *categories, scope);
+
+            if (m_searchLimit > 0 && parts.size() > static_cast<size_t>(m_searchLimit))
+                parts.erase(parts.begin() + m_searchLimit, parts.end());
+
+            return parts;
+        };
+
+        if (server->m_offline) {
+            std::lock_guard<std::mutex> guard(merged->m_mutex);
+            mergeFoundParts(searchSnapshot(), *merged);
+            continue;
+        }
+
+        // a refinement of an earlier search, e.g. while the user is typing, is filtered locally
+        std::vector<FOUND_PART> cached;
+        if (m_searchCache.lookup(serverIdx, searchTerm, cached)) {
+            m_metrics.m_searchCacheHits++;
+            scopeToCategory(cached, *categories, scope);
+
+            std::lock_guard<std::mutex> guard(merged->m_mutex);
+            mergeFoundParts(cached, *merged);
+            continue;
+        }
+
+        m_metrics.m_searchCacheMisses++;
+
+        searches.push_back(
+                getJSONRequest(server, _PART_SEARCH, server->m_apiURL + "part/", serverQuery)
+                        .then([=](pplx::task<json::value> jsonResponse) {
+                            bool complete = false;
+                            std::vector<FOUND_PART> parts;
+
+                            try {
+                                // evaluate JSON response
+                                json::value obj = evaluateJSONResponse(std::move(jsonResponse));
+
+                                if (!obj.is_null()) {
+                                    parts = parseFoundParts(obj, serverIdx, complete,
+                                                            categories.get());
+
+                                    // a truncated result set can not answer refined searches,
+                                    // a scoped one only answers searches in the same category
+                                    if (complete && scope < 0)
+                                        m_searchCache.insert(serverIdx, searchTerm, parts);
+
+                                    // in case the server ignored the category filter
+                                    scopeToCategory(parts, *categories, scope);
+                                } else if (snapshot) {
+                                    parts = searchSnapshot();
+                                }
+                            }
+                            catch (http_exception const &e) {
+                                DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                                           "searchWareHouseForParts(): " << server->m_tag
+                                                                         << ": " << e.what());
 
-                }
-                catch (http_exception const &e) {
 //                    fCallbackDisplayStatusMessage(e.what(), "searchWareHouseForParts()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
 
-                    // clear parts and update connection status msg
-                    m_foundParts.clear();
-                }
-            })
-            .wait();
+                                // the server went away since the driver connected
+                                if (!snapshot)
+                                    return;
+
+                                parts = searchSnapshot();
+                            }
+
+                            std::lock_guard<std::mutex> guard(merged->m_mutex);
+                            mergeFoundParts(parts, *merged);
+                        }));
+    }
+
+    pplx::when_all(searches.begin(), searches.end()).wait();
+
+    // clear parts if no server answered
+    if (!merged->m_delivered)
+        std::atomic_store(&m_foundParts, std::make_shared<const std::vector<FOUND_PART>>());
 }
 
-void INVENTREE_DRIVER::getAllParameterTemplates() {
-    std::cout << "getAllParameterTemplates" << std::endl;
+void INVENTREE_DRIVER::scopeToCategory(std::vector<FOUND_PART> &parts,
+                                       const CATEGORY_INDEX &categories, int category) {
+    if (category < 0)
+        return;
 
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-    req.headers().add("Authorization", "Token " + m_apiToken);
+    parts.erase(std::remove_if(parts.begin(), parts.end(), [&](const FOUND_PART &part) {
+        return part.m_category >= 0 && !categories.contains(category, part.m_category);
+    }), parts.end());
+}
 
-    // create http client
-    http_client client(m_ApiURL + "part/parameter/template/");
+std::vector<FOUND_PART> INVENTREE_DRIVER::parseFoundParts(const json::value &obj, int server,
+                                                          bool &complete,
+                                                          const CATEGORY_INDEX *categories) {
+    std::vector<FOUND_PART> parts;
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
-            .then([=](pplx::task<json::value> jsonResponse) {
+    // InvenTree only paginates if a limit was requested
+    const json::value *list = &obj;
+    complete = true;
+
+    if (obj.is_object() && obj.has_field(U("results"))) {
+        list = &obj.at(U("results"));
+
+        if (obj.has_field(U("count")) && obj.at(U("count")).is_number())
+            complete = obj.at(U("count")).as_integer() <= static_cast<int>(list->size());
+    }
+
+    if (!list->is_array()) {
+        complete = false;
+        return parts;
+    }
+
+    // only keep what is needed to list, select and refine the part, the server may have ignored
+    // the field projection
+    for (auto &part : list->as_array()) {
+        FOUND_PART found(part.has_field(U("pk")) ? part.at(U("pk")).as_integer() : -1,
+                         stringField(part, U("description")),
+                         stringField(part, U("image")).ToStdString(), server);
+
+        found.m_IPN = stringField(part, U("IPN"));
+
+        if (part.has_field(U("category")) && part.at(U("category")).is_integer())
+            found.m_category = part.at(U("category")).as_integer();
+
+        wxString text = stringField(part, U("name")) + " " + found.m_IPN + " " +
+                        stringField(part, U("revision")) + " " + found.m_description + " " +
+                        stringField(part, U("keywords"));
+
+        if (part.has_field(U("tags")) && part.at(U("tags")).is_array()) {
+            for (const auto &tag : part.at(U("tags")).as_array()) {
+                if (tag.is_string())
+                    text += " " + wxString(tag.as_string());
+            }
+        }
+
+        // the server also searches the name of the category and the manufacturer and supplier
+        // part numbers, the part is only complete if all of them are known
+        bool searchComplete = false;
+
+        if (categories) {
+            const PART_CATEGORY *category =
+                    found.m_category >= 0 ? categories->find(found.m_category) : nullptr;
+            std::string numbers;
+
+            if (category)
+                text += " " + category->m_name;
+
+            bool fields = true;
+            for (const auto &field : {U("name"), U("IPN"), U("revision"), U("description"),
+                                      U("keywords"), U("tags"), U("category")})
+                fields = fields && part.has_field(field);
+
+            searchComplete = fields && (category || part.at(U("category")).is_null()) &&
+                             m_partNumbers.numbers(server, found.m_pk, numbers);
+
+            if (!numbers.empty())
+                text += " " + wxString::FromUTF8(numbers.c_str());
+        }
+
+        found.m_searchText = SEARCH_CACHE::toLower(std::string(text.utf8_str()));
+        found.m_searchComplete = searchComplete;
+
+        parts.push_back(std::move(found));
+    }
+
+    return parts;
+}
+
+void INVENTREE_DRIVER::mergeFoundParts(const std::vector<FOUND_PART> &parts,
+                                       MERGED_SEARCH &merged) {
+    bool federated = m_servers.size() > 1;
+
+    for (const auto &part : parts) {
+        // a part kept on several servers is listed once, by the server which answered first. Only
+        // the IPN tells that it is the same part, descriptions like "resistor" are not unique
+        if (!part.m_IPN.empty()) {
+            auto seen = merged.m_seen.insert(std::make_pair(part.m_IPN.Lower(), part.m_server));
+            if (!seen.second && seen.first->second != part.m_server)
+                continue;
+        }
+
+        merged.m_parts.push_back(part);
+        merged.m_list.emplace_back(
+                federated ? "[" + m_servers[part.m_server]->m_tag + "] " + part.m_description
+                          : part.m_description);
+    }
+
+    // publish before the callback, so a selection from the list finds the parts
+    std::atomic_store(&m_foundParts,
+                      std::make_shared<const std::vector<FOUND_PART>>(merged.m_parts));
+    merged.m_delivered = true;
+
+    // every answer extends the list, so a slow server never holds back the others
+    fCallbackDisplayFoundParts(merged.m_list, m_driverID);
+}
+
+std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> INVENTREE_DRIVER::getAllParameterTemplates(
+        const SERVER_PTR &server, bool publish) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getAllParameterTemplates");
+
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> received;
+
+    getJSONRequest(server, _PARAMETER_TEMPLATES, server->m_apiURL + "part/parameter/template/")
+            .then([=, &received](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
                     json::value obj = evaluateJSONResponse(std::move(jsonResponse));
@@ -319,8 +1180,9 @@ void INVENTREE_DRIVER::getAllParameterTemplates() {
                         // convert json object to array
                         json::array templates = obj.as_array();
 
-                        // clear templates
-                        m_parameterTemplates.clear();
+                        // build a new snapshot, readers keep using the previous one meanwhile
+                        auto parameterTemplates =
+                                std::make_shared<std::vector<TEMPLATE_PARAMETER>>();
 
                         int pk = -1;
                         std::string name;
@@ -342,46 +1204,41 @@ void INVENTREE_DRIVER::getAllParameterTemplates() {
                                     units = propertyValue.serialize();
                             }
 
-                            m_parameterTemplates.emplace_back(
+                            parameterTemplates->emplace_back(
                                     TEMPLATE_PARAMETER(pk, removeQuotationMarks(name),
                                                        removeQuotationMarks(units)));
                         }
 
-                        std::cout << m_parameterTemplates.size() << " template(s) received"
-                                  << std::endl;
-                    } else {
-                        // clear parts and update connection status msg
-                        m_foundParts.clear();
+                        DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                                   parameterTemplates->size() << " template(s) received");
+
+                        received = parameterTemplates;
+
+                        if (publish)
+                            std::atomic_store(&server->m_reference->m_parameterTemplates, received);
                     }
                 }
                 catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                               "getAllParameterTemplates(): " << e.what());
+
 //                    fCallbackDisplayStatusMessage(e.what(), "getAllParameterTemplates()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
-
-                    // clear parts and update connection status msg
-                    m_foundParts.clear();
                 }
             })
             .wait();
-}
 
-void INVENTREE_DRIVER::getAllStockLocations() {
-    std::cout << "getAllStockLocations" << std::endl;
+    return received;
+}
 
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-    req.headers().add("Authorization", "Token " + m_apiToken);
+std::shared_ptr<const STOCK_LOCATION_INDEX> INVENTREE_DRIVER::getAllStockLocations(
+        const SERVER_PTR &server, bool publish) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getAllStockLocations");
 
-    // create http client
-    http_client client(m_ApiURL + "stock/location/");
+    std::shared_ptr<const STOCK_LOCATION_INDEX> received;
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
-            .then([=](pplx::task<json::value> jsonResponse) {
+    getJSONRequest(server, _STOCK_LOCATIONS, server->m_apiURL + "stock/location/")
+            .then([=, &received](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
                     json::value obj = evaluateJSONResponse(std::move(jsonResponse));
@@ -390,19 +1247,19 @@ void INVENTREE_DRIVER::getAllStockLocations() {
                         // convert json object to array
                         json::array templates = obj.as_array();
 
-                        // clear templates
-                        m_stockLocations.clear();
-
-                        int pk = -1;
-                        int parent = -1;
-                        int items = -1;
-                        std::string url;
-                        std::string name;
-                        std::string description;
-                        std::string pathstring;
+                        std::vector<STOCK_LOCATION> stockLocations;
 
                         // map received templates in global vector for later use
                         for (const auto &iter : templates) {
+                            // top level locations have no parent
+                            int pk = -1;
+                            int parent = -1;
+                            int items = -1;
+                            std::string url;
+                            std::string name;
+                            std::string description;
+                            std::string pathstring;
+
                             for (const auto &temp : iter.as_object()) {
                                 auto &propertyName = temp.first;
                                 auto &propertyValue = temp.second;
@@ -436,51 +1293,102 @@ void INVENTREE_DRIVER::getAllStockLocations() {
                                     pathstring = propertyValue.serialize();
                             }
 
-                            m_stockLocations.emplace_back(STOCK_LOCATION(
+                            stockLocations.emplace_back(STOCK_LOCATION(
                                     pk, parent, items, url, removeQuotationMarks(name),
                                     removeQuotationMarks(description),
                                     removeQuotationMarks(pathstring)));
                         }
 
-                        std::cout << m_stockLocations.size() << " location(s) received"
-                                  << std::endl;
-                    } else {
-                        // clear parts and update connection status msg
-                        m_foundParts.clear();
+                        DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                                   stockLocations.size() << " location(s) received");
+
+                        // build a new snapshot with the tree and the stock of every subtree,
+                        // readers keep using the previous one meanwhile
+                        received = std::make_shared<const STOCK_LOCATION_INDEX>(
+                                std::move(stockLocations));
+
+                        if (publish)
+                            std::atomic_store(&server->m_reference->m_stockLocations, received);
                     }
                 }
                 catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getAllStockLocations(): " << e.what());
+
 //                    fCallbackDisplayStatusMessage(e.what(), "getAllStockLocations()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
-
-                    // clear parts and update connection status msg
-                    m_foundParts.clear();
                 }
             })
             .wait();
+
+    return received;
 }
 
-void INVENTREE_DRIVER::getPartAttributes(int pk) {
-    std::cout << "getPartAttributes" << std::endl;
+std::shared_ptr<const CATEGORY_INDEX> INVENTREE_DRIVER::getAllPartCategories(
+        const SERVER_PTR &server, bool publish) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getAllPartCategories");
 
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-    req.headers().add("Authorization", "Token " + m_apiToken);
+    std::shared_ptr<const CATEGORY_INDEX> received;
+
+    getJSONRequest(server, _PART_CATEGORIES, server->m_apiURL + "part/category/")
+            .then([=, &received](pplx::task<json::value> jsonResponse) {
+                try {
+                    // evaluate JSON response
+                    json::value obj = evaluateJSONResponse(std::move(jsonResponse));
+
+                    if (!obj.is_array())
+                        return;
 
-    // create http client
-    http_client client(m_ApiURL + "part/" + std::to_string(pk) + "/");
+                    std::vector<PART_CATEGORY> categories;
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
+                    for (const auto &category : obj.as_array()) {
+                        if (!category.has_field(U("pk")) || !category.at(U("pk")).is_integer())
+                            continue;
+
+                        // top level categories have no parent
+                        int parent = -1;
+                        if (category.has_field(U("parent")) &&
+                            category.at(U("parent")).is_integer())
+                            parent = category.at(U("parent")).as_integer();
+
+                        categories.emplace_back(PART_CATEGORY(
+                                category.at(U("pk")).as_integer(), parent,
+                                stringField(category, U("name")),
+                                stringField(category, U("description"))));
+                    }
+
+                    DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                               categories.size() << " categories received");
+
+                    // paths and subtrees are built once, readers keep the previous index meanwhile
+                    received = std::make_shared<const CATEGORY_INDEX>(std::move(categories));
+
+                    if (publish)
+                        std::atomic_store(&server->m_reference->m_partCategories, received);
+                }
+                catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getAllPartCategories(): " << e.what());
+                }
             })
-            .then([=](pplx::task<json::value> jsonResponse) {
+            .wait();
+
+    return received;
+}
+
+std::vector<PART_ATTRIBUTE> INVENTREE_DRIVER::getPartAttributes(const SERVER_PTR &server, int pk) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getPartAttributes");
+
+    std::vector<PART_ATTRIBUTE> attributes;
+    std::shared_ptr<const STOCK_LOCATION_INDEX> stockLocations =
+            std::atomic_load(&server->m_reference->m_stockLocations);
+    std::shared_ptr<const CATEGORY_INDEX> categories =
+            std::atomic_load(&server->m_reference->m_partCategories);
+    std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = std::atomic_load(&server->m_snapshot);
+
+    getJSONRequest(server, _PART_DETAIL, server->m_apiURL + "part/" + std::to_string(pk) + "/")
+            .then([=, &attributes](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
                     json::value obj = evaluateJSONResponse(std::move(jsonResponse));
-                    m_partAttributes.clear();
 
                     if (!obj.is_null()) {
                         // extract attributes and store in vector
@@ -488,45 +1396,63 @@ void INVENTREE_DRIVER::getPartAttributes(int pk) {
                             auto &propertyName = attr.first;
                             auto &propertyValue = attr.second;
 
-                            m_partAttributes.emplace_back(PART_ATTRIBUTE(
+                            // skip whatever a server without field projection sent on top
+                            if (!visibleAttributes(removeQuotationMarks(propertyName)))
+                                continue;
+
+                            attributes.emplace_back(PART_ATTRIBUTE(
                                     removeQuotationMarks(propertyName),
                                     removeQuotationMarks(propertyValue.serialize()),
-                                    m_stockLocations));
+                                    stockLocations.get(), categories.get()));
+
+                            if (attributes.back().m_name != "default_location")
+                                continue;
+
+                            int location = propertyValue.is_integer() ? propertyValue.as_integer()
+                                                                      : -1;
+
+                            // locations which were not loaded by this session
+                            const SNAPSHOT_LOCATION *snapshotLocation =
+                                    snapshot && stockLocations->size() == 0
+                                    ? snapshot->findLocation(location) : nullptr;
+                            if (snapshotLocation)
+                                attributes.back().m_value =
+                                        snapshot->string(snapshotLocation->m_pathstring) + " ->> " +
+                                        snapshot->string(snapshotLocation->m_description);
+
+                            // the stock of every location on the way, from the building down
+                            wxString rollUp = stockLocations->rollUpText(location);
+                            if (!rollUp.empty())
+                                attributes.emplace_back(PART_ATTRIBUTE("location_stock", rollUp));
                         }
                     }
                 }
                 catch (http_exception const &e) {
-                    m_foundParts.clear();
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getPartAttributes(): " << e.what());
 
 //                    fCallbackDisplayStatusMessage(e.what(), "getPartAttributes()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
                 }
             })
             .wait();
-}
 
-void INVENTREE_DRIVER::getPartParameters(int pk) {
-    std::cout << "getPartParameters" << std::endl;
+    return attributes;
+}
 
-    // create request, and add header information
-    web::http::http_request req(methods::GET);
-    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
-    req.headers().add("Authorization", "Token " + m_apiToken);
-    req.set_request_uri("?part=" + std::to_string(pk));
+std::vector<PART_PARAMETER> INVENTREE_DRIVER::getPartParameters(const SERVER_PTR &server, int pk) {
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "getPartParameters");
 
-    // create http client
-    http_client client(m_ApiURL + "part/parameter/");
+    std::vector<PART_PARAMETER> parameters;
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> parameterTemplates =
+            std::atomic_load(&server->m_reference->m_parameterTemplates);
+    std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = std::atomic_load(&server->m_snapshot);
 
-    client.request(req)
-            .then([=](http_response response) {
-                // evaluate server response
-                return evaluateServerResponse(std::move(response));
-            })
-            .then([=](pplx::task<json::value> jsonResponse) {
+    getJSONRequest(server, _PART_PARAMETERS,
+                   server->m_apiURL + "part/parameter/", "?part=" + std::to_string(pk))
+            .then([=, &parameters](pplx::task<json::value> jsonResponse) {
                 try {
                     // evaluate JSON response
                     json::value obj = evaluateJSONResponse(std::move(jsonResponse));
-                    m_partParameters.clear();
 
                     if (!obj.is_null()) {
                         // extract attributes and store in vector
@@ -558,28 +1484,309 @@ void INVENTREE_DRIVER::getPartParameters(int pk) {
                                 }
                             }
 
-                            m_partParameters.emplace_back(PART_PARAMETER(
+                            parameters.emplace_back(PART_PARAMETER(
                                     _pk, _part, _template, removeQuotationMarks(_data),
-                                    m_parameterTemplates));
+                                    *parameterTemplates));
+
+                            // templates which were not loaded or created by this session
+                            PART_PARAMETER &parameter = parameters.back();
+                            if (snapshot && parameter.m_template.empty()) {
+                                const SNAPSHOT_TEMPLATE *t = snapshot->findTemplate(_template);
+                                if (t) {
+                                    parameter.m_template = snapshot->string(t->m_name);
+                                    parameter.m_units = snapshot->string(t->m_units);
+                                }
+                            }
                         }
                     }
                 }
                 catch (http_exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "getPartParameters(): " << e.what());
+
 //                    fCallbackDisplayStatusMessage(e.what(), "getPartParameters()",
 //                                                  IWareHouse::Display::_ERROR_DIALOG);
                 }
             })
             .wait();
+
+    return parameters;
 }
 
 bool INVENTREE_DRIVER::addPartToWareHouse(std::map<wxString, wxString> parameters) {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+
+    if (m_servers.empty())
+        return false;
+
+    bool created = createPart(m_servers.front(), parameters).get();
+
+    // cached search results do not know the new part
+    m_searchCache.clear();
+
+    return created;
+}
+
+size_t INVENTREE_DRIVER::addPartsToWareHouse(
+        const std::vector<std::map<wxString, wxString>> &parts,
+        std::function<void(size_t, size_t)> progress) {
+    std::shared_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+
+    if (m_servers.empty() || parts.empty())
+        return 0;
+
+    const SERVER_PTR &server = m_servers.front();
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<size_t> created{0};
+    std::mutex progressMutex;
+
+    size_t laneCount = std::min(parts.size(), static_cast<size_t>(m_bulkParallelism));
+    std::vector<pplx::task_completion_event<void>> finished(laneCount);
 
-    // TODO: do something....
-    for (auto &p : parameters) {
-        std::cout << p.first << ": " << p.first << std::endl;
+    // each lane creates one part after the other, the parameters of a part are sent at once. A
+    // lane only holds a thread of the executor while it prepares the next part, never while it
+    // waits for the server
+    std::function<void(size_t)> lane = [&](size_t l) {
+        size_t idx = next++;
+        if (idx >= parts.size()) {
+            finished[l].set();
+            return;
+        }
+
+        createPart(server, parts[idx]).then([&, l](bool partCreated) {
+            try {
+                if (partCreated)
+                    created++;
+
+                size_t count = ++done;
+
+                DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                           "Imported " << count << " of " << parts.size() << " part(s)");
+
+                if (progress) {
+                    std::lock_guard<std::mutex> guard(progressMutex);
+                    progress(count, parts.size());
+                }
+            }
+            catch (...) {
+                finished[l].set_exception(std::current_exception());
+                return;
+            }
+
+            lane(l);
+        }, pplx::task_options(m_executor.scheduler(REQUEST_EXECUTOR::_BACKGROUND)));
+    };
+
+    std::vector<pplx::task<void>> lanes;
+
+    for (size_t l = 0; l < laneCount; l++) {
+        lanes.push_back(pplx::create_task(finished[l]));
+        lane(l);
     }
 
-    return true;
+    pplx::when_all(lanes.begin(), lanes.end()).wait();
+
+    // cached search results do not know the new parts
+    m_searchCache.clear();
+
+    return created;
+}
+
+pplx::task<bool> INVENTREE_DRIVER::createPart(const SERVER_PTR &server,
+                                              const std::map<wxString, wxString> &parameters) {
+    // distributor data -> fields of the part, everything else becomes a parameter
+    const char *partFields[][2] = {{"name",        "name"},
+                                   {"description", "description"},
+                                   {"ipn",         "IPN"},
+                                   {"keywords",    "keywords"},
+                                   {"link",        "link"},
+                                   {"datasheet",   "link"},
+                                   {"notes",       "notes"},
+                                   {"units",       "units"},
+                                   {"revision",    "revision"}};
+
+    json::value part = json::value::object();
+    std::map<wxString, wxString> partParameters;
+    wxString mpn;
+    long category = m_defaultCategory;
+
+    for (const auto &p : parameters) {
+        wxString key = normalizeKey(p.first);
+        bool isField = false;
+
+        if (p.second.empty())
+            continue;
+
+        for (const auto &field : partFields) {
+            if (key == field[0]) {
+                part[utility::conversions::to_string_t(field[1])] =
+                        json::value::string(utility::conversions::to_string_t(
+                                std::string(p.second.utf8_str())));
+                isField = true;
+                break;
+            }
+        }
+
+        if (key == "category") {
+            if (!p.second.ToLong(&category))
+                DRIVER_LOG(INVENTREE_LOGGER::_WARNING, "Ignoring category " << p.second);
+            isField = true;
+        } else if (key == "manufacturer part number" || key == "mpn") {
+            mpn = p.second;
+        }
+
+        if (!isField)
+            partParameters[p.first] = p.second;
+    }
+
+    if (!part.has_field(U("name")) && !mpn.empty())
+        part[U("name")] = json::value::string(
+                utility::conversions::to_string_t(std::string(mpn.utf8_str())));
+
+    if (!part.has_field(U("name"))) {
+        DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "addPartToWareHouse(): part without name");
+        return pplx::task_from_result(false);
+    }
+
+    if (category > 0)
+        part[U("category")] = json::value::number(static_cast<int>(category));
+
+    part[U("component")] = json::value::boolean(true);
+
+    return postJSONRequest(server, server->m_apiURL + "part/", part).then(
+            [=](json::value created) -> pplx::task<bool> {
+        int pk = created.at(U("pk")).as_integer();
+
+        // the new part is found by its IPN right away, not only after the next connect. Its MPN
+        // only becomes a parameter, not a manufacturer part, and is not indexed
+        auto serverIdx = std::find(m_servers.begin(), m_servers.end(), server);
+        if (m_partNumberIndex && part.has_field(U("IPN")) && serverIdx != m_servers.end())
+            m_partNumbers.add(static_cast<int>(serverIdx - m_servers.begin()),
+                              std::string(stringField(part, U("IPN")).utf8_str()), pk);
+
+        // all parameters in one round trip, missing templates are created on the way
+        std::vector<pplx::task<bool>> requests;
+
+        for (const auto &p : partParameters) {
+            std::string data = std::string(p.second.utf8_str());
+
+            requests.push_back(resolveTemplate(server, p.first).then([=](int templatePk) {
+                json::value parameter = json::value::object();
+                parameter[U("part")] = json::value::number(pk);
+                parameter[U("template")] = json::value::number(templatePk);
+                parameter[U("data")] = json::value::string(
+                        utility::conversions::to_string_t(data));
+
+                return postJSONRequest(server, server->m_apiURL + "part/parameter/", parameter);
+            }).then([=](pplx::task<json::value> request) {
+                try {
+                    request.get();
+                    return true;
+                }
+                catch (const std::exception &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                               "Failed to add parameter to part " << pk << ": " << e.what());
+                }
+
+                return false;
+            }));
+        }
+
+        if (requests.empty()) {
+            DRIVER_LOG(INVENTREE_LOGGER::_INFO, "Created part " << pk << " with 0 parameter(s)");
+            return pplx::task_from_result(true);
+        }
+
+        return pplx::when_all(requests.begin(), requests.end()).then(
+                [=](std::vector<bool> added) {
+                    size_t failed = std::count(added.begin(), added.end(), false);
+
+                    DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                               "Created part " << pk << " with " << added.size() - failed
+                                               << " parameter(s)");
+
+                    return failed == 0;
+                });
+    }).then([=](pplx::task<bool> result) {
+        try {
+            return result.get();
+        }
+        catch (const std::exception &e) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR, "addPartToWareHouse(): " << e.what());
+        }
+
+        return false;
+    });
+}
+
+pplx::task<int> INVENTREE_DRIVER::resolveTemplate(const SERVER_PTR &server,
+                                                  const wxString &name) {
+    wxString key = normalizeKey(name);
+
+    std::lock_guard<std::mutex> lock(server->m_templateMutex);
+
+    if (!server->m_templateIndexBuilt) {
+        std::shared_ptr<const CATALOG_SNAPSHOT> snapshot = std::atomic_load(&server->m_snapshot);
+
+        if (snapshot) {
+            for (size_t i = 0; i < snapshot->templateCount(); i++) {
+                const SNAPSHOT_TEMPLATE &t = snapshot->templateAt(i);
+                server->m_templateIndex[normalizeKey(snapshot->string(t.m_name))] =
+                        pplx::task_from_result(static_cast<int>(t.m_pk));
+            }
+        }
+
+        // templates loaded or created by this session are more recent
+        for (const auto &t : *std::atomic_load(&server->m_reference->m_parameterTemplates))
+            server->m_templateIndex[normalizeKey(t.m_name)] = pplx::task_from_result(t.m_pk);
+
+        server->m_templateIndexBuilt = true;
+    }
+
+    auto known = server->m_templateIndex.find(key);
+    if (known != server->m_templateIndex.end())
+        return known->second;
+
+    DRIVER_LOG(INVENTREE_LOGGER::_INFO, "Creating parameter template " << name);
+
+    json::value body = json::value::object();
+    body[U("name")] = json::value::string(
+            utility::conversions::to_string_t(std::string(name.utf8_str())));
+
+    pplx::task<int> created = postJSONRequest(
+            server, server->m_apiURL + "part/parameter/template/", body).then(
+            [server, name](json::value obj) {
+                int pk = obj.at(U("pk")).as_integer();
+
+                // publish the template, so part details show its name
+                std::lock_guard<std::mutex> lock(server->m_reference->m_updateMutex);
+
+                auto templates = std::make_shared<std::vector<TEMPLATE_PARAMETER>>(
+                        *std::atomic_load(&server->m_reference->m_parameterTemplates));
+                templates->emplace_back(TEMPLATE_PARAMETER(pk, name, ""));
+
+                std::atomic_store(&server->m_reference->m_parameterTemplates,
+                                  std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>>(
+                                          templates));
+                return pk;
+            });
+
+    // parts which are created meanwhile wait for the same template
+    server->m_templateIndex[key] = created;
+
+    created.then([server, key](pplx::task<int> result) {
+        try {
+            result.get();
+        }
+        catch (...) {
+            // try again with the next part
+            std::lock_guard<std::mutex> lock(server->m_templateMutex);
+            server->m_templateIndex.erase(key);
+        }
+    });
+
+    return created;
 }
 
 
@@ -587,28 +1794,32 @@ bool INVENTREE_DRIVER::addPartToWareHouse(std::map<wxString, wxString> parameter
 size_t callbackFunctionWriteFile(void *ptr, size_t size, size_t nmemb, void *userdata) {
     FILE *stream = (FILE *) userdata;
     if (!stream) {
-        std::cout << "!!! No stream" << std::endl;
+        INVENTREE_LOG(INVENTREE_LOGGER::_ERROR, "!!! No stream");
         return 0;
     }
 
     try {
         size_t written = fwrite((FILE *) ptr, size, nmemb, stream);
 
-        std::cout << "File has been saved..." << std::endl;
+        INVENTREE_LOG(INVENTREE_LOGGER::_TRACE, written * size << " byte(s) of image data saved");
 
         return written;
     }
     catch (...) {
-        std::cout << "error" << std::endl;
+        INVENTREE_LOG(INVENTREE_LOGGER::_ERROR, "Failed to write image data");
     }
 
     return 0;
 }
 
-bool downloadImagesFile(std::string url) {
+bool downloadImagesFile(std::string url, long timeoutMs, size_t *wireBytes) {
+    // every download goes to the same file, concurrent selections must not interleave
+    static std::mutex imageFileMutex;
+    std::lock_guard<std::mutex> lock(imageFileMutex);
+
     FILE *fp = fopen("part_image.tmpfile", "wb");
     if (!fp) {
-        std::cout << "!!! Failed to create file on the disk" << std::endl;
+        INVENTREE_LOG(INVENTREE_LOGGER::_ERROR, "!!! Failed to create file on the disk");
         return false;
     }
 
@@ -618,70 +1829,1095 @@ bool downloadImagesFile(std::string url) {
     curl_easy_setopt(curlCtx, CURLOPT_WRITEFUNCTION, callbackFunctionWriteFile);
     curl_easy_setopt(curlCtx, CURLOPT_FOLLOWLOCATION, 1);
 
-    CURLcode rc = curl_easy_perform(curlCtx);
-    if (rc) {
-        std::cout << "!!! Failed to download: " << url.c_str() << std::endl;
-        return false;
+    // let curl negotiate and decode every content encoding it was built with
+    curl_easy_setopt(curlCtx, CURLOPT_ACCEPT_ENCODING, "");
+
+    // a stalled server must not freeze KiCad, signals can not be used for timeouts in threads
+    if (timeoutMs > 0) {
+        curl_easy_setopt(curlCtx, CURLOPT_TIMEOUT_MS, timeoutMs);
+        curl_easy_setopt(curlCtx, CURLOPT_NOSIGNAL, 1L);
     }
 
+    CURLcode rc = curl_easy_perform(curlCtx);
+
     long res_code = 0;
     curl_easy_getinfo(curlCtx, CURLINFO_RESPONSE_CODE, &res_code);
-    if (!((res_code == 200 || res_code == 201) && rc != CURLE_ABORTED_BY_CALLBACK)) {
-        std::cout << "!!! Response code: " << res_code << std::endl;
-        return false;
+
+    if (wireBytes) {
+        curl_off_t downloaded = 0;
+        curl_easy_getinfo(curlCtx, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+        *wireBytes = static_cast<size_t>(downloaded);
     }
 
     curl_easy_cleanup(curlCtx);
 
     fclose(fp);
 
-    return true;
-}
-
-/***** General evaluation functions ********/
-pplx::task<json::value> INVENTREE_DRIVER::evaluateServerResponse(http_response response) {
-    if (response.status_code() == status_codes::OK) {
-        return response.extract_json();
+    if (rc) {
+        INVENTREE_LOG(INVENTREE_LOGGER::_WARNING, "!!! Failed to download: " << url);
+        return false;
     }
 
-//    fCallbackDisplayStatusMessage(
-//            wxString::Format("Error during communication with InvenTree.\nError Code: %d ( %s )",
-//                             response.status_code(), response.reason_phrase()),
-//            "Server Response", IWareHouse::Display::_ERROR_DIALOG);
+    if (!((res_code == 200 || res_code == 201) && rc != CURLE_ABORTED_BY_CALLBACK)) {
+        INVENTREE_LOG(INVENTREE_LOGGER::_WARNING, "!!! Response code: " << res_code);
+        return false;
+    }
 
-    return pplx::task_from_result(json::value());
+    return true;
 }
 
-json::value INVENTREE_DRIVER::evaluateJSONResponse(pplx::task<json::value> jsonResponse) {
-    json::value obj = jsonResponse.get();
-    if (!obj.is_null()) {
-        return obj;
+/***** Request handling ********/
+pplx::task<json::value> INVENTREE_DRIVER::getJSONRequest(const SERVER_PTR &server,
+                                                         Endpoint endpoint,
+                                                         const std::string &url,
+                                                         const std::string &query,
+                                                         const web::credentials &cred) {
+    m_metrics.m_jsonRequests++;
+
+    // requests carrying credentials are never shared
+    if (!cred.username().empty()) {
+        return getRequest(server, endpoint, url, query, cred).then([=](http_response response) {
+            return evaluateServerResponse(std::move(response), laneOf(endpoint));
+        });
     }
 
-//    fCallbackDisplayStatusMessage(
-//            "Server did not respond as expected. Not sure what to do... I think I am cooked... I am so sorry...",
-//            "Server Response", IWareHouse::Display::_ERROR_DIALOG);
+    // endpoints asking for the same list may project different fields, only requests which
+    // would send the same url share a response
+    std::string key = url + projectFields(server, endpoint, query);
+    pplx::task<json::value> request;
 
-    return json::value();
-}
+    {
+        std::lock_guard<std::mutex> lock(m_inFlightMutex);
 
-wxString INVENTREE_DRIVER::removeQuotationMarks(std::string str) {
-    // Check if " is present in first position and if so delete the on at the front and at the end
-    // of the string
-    if (str.find('\"') == 0) {
-        str.erase(str.begin());
-        str.erase(str.end() - 1);
+        // attach to an identical request which is still in flight
+        auto inFlight = m_inFlight.find(key);
+        if (inFlight != m_inFlight.end()) {
+            m_metrics.m_coalescedRequests++;
+            return inFlight->second;
+        }
+
+        request = getRequest(server, endpoint, url, query).then([=](http_response response) {
+            return evaluateServerResponse(std::move(response), laneOf(endpoint));
+        });
+
+        m_inFlight[key] = request;
     }
 
-    return str;
-}
+    // the next identical request goes to the server again, the driver must outlive the cleanup
+    beginRequest();
 
-bool INVENTREE_DRIVER::visibleAttributes(const wxString &term) {
-    std::vector<wxString> selector = {
-            "description", "default_location", "full_name", "in_stock", "link", "notes", "pk"
+    request.then([this, key](pplx::task<json::value>) {
+        {
+            // no other request for the key can have been added while this one was in flight
+            std::lock_guard<std::mutex> lock(m_inFlightMutex);
+            m_inFlight.erase(key);
+        }
+
+        endRequest();
+    });
+
+    return request;
+}
+
+pplx::task<http_response> INVENTREE_DRIVER::getRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                                       const std::string &url,
+                                                       const std::string &query,
+                                                       const web::credentials &cred) {
+    std::string projected = projectFields(server, endpoint, query);
+
+    if (projected == query)
+        return dispatchGetRequest(server, endpoint, url, query, cred);
+
+    return dispatchGetRequest(server, endpoint, url, projected, cred).then(
+            [=](http_response response) -> pplx::task<http_response> {
+                if (response.status_code() != status_codes::BadRequest)
+                    return pplx::task_from_result(response);
+
+                // the server rejects the projection, ask for complete objects from now on
+                server->m_projectionRejected[endpoint] = true;
+
+                DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                           "Field projection not supported by " << url
+                                                                << ", requesting all fields");
+
+                return dispatchGetRequest(server, endpoint, url, query, cred);
+            });
+}
+
+std::string INVENTREE_DRIVER::projectFields(const SERVER_PTR &server, Endpoint endpoint,
+                                            const std::string &query) const {
+    if (!m_fieldProjection || server->m_projectionRejected[endpoint] ||
+        m_projectedFields[endpoint].empty())
+        return query;
+
+    return query + (query.empty() ? "?" : "&") + "fields=" +
+           uri::encode_data_string(m_projectedFields[endpoint]);
+}
+
+pplx::task<http_response> INVENTREE_DRIVER::dispatchGetRequest(const SERVER_PTR &server,
+                                                               Endpoint endpoint,
+                                                               const std::string &url,
+                                                               const std::string &query,
+                                                               const web::credentials &cred) {
+    const REQUEST_POLICY &policy = m_requestPolicies[endpoint];
+    auto deadline = std::chrono::steady_clock::now() + policy.m_deadline;
+
+    pplx::task<http_response> primary = sendGetRequest(server, endpoint, url, query, cred,
+                                                       deadline, 1, policy.m_maxRetries + 1);
+
+    // hedging only makes sense once we know what a slow answer looks like
+    std::chrono::microseconds p95 = server->m_latencies[endpoint].percentile(0.95);
+    if (!policy.m_hedge || p95.count() == 0)
+        return primary;
+
+    std::chrono::microseconds delay = std::max<std::chrono::microseconds>(p95,
+                                                                          policy.m_minHedgeDelay);
+
+    return hedgeRequest(primary, delay, [=]() {
+        // the duplicate gets a single attempt within the same deadline
+        return sendGetRequest(server, endpoint, url, query, cred, deadline, 1, 1);
+    });
+}
+
+pplx::task<http_response> INVENTREE_DRIVER::sendGetRequest(
+        const SERVER_PTR &server, Endpoint endpoint, const std::string &url,
+        const std::string &query, const web::credentials &cred,
+        std::chrono::steady_clock::time_point deadline, int attempt, int maxAttempts) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+
+    if (remaining.count() <= 0) {
+        return pplx::task_from_exception<http_response>(
+                http_exception("Deadline exceeded for " + url + query));
+    }
+
+    const REQUEST_POLICY &policy = m_requestPolicies[endpoint];
+    std::string host = server->m_serverURL;
+
+    // create request, and add header information
+    web::http::http_request req(methods::GET);
+    req.headers().add(header_names::content_type, http::details::mime_types::application_json);
+
+    if (endpoint != _API_VERSION && endpoint != _AUTH_TOKEN)
+        req.headers().add("Authorization", "Token " + server->m_apiToken);
+
+    if (!m_acceptEncoding.empty())
+        req.headers().add(header_names::accept_encoding, m_acceptEncoding);
+
+    if (!query.empty())
+        req.set_request_uri(query);
+
+    // held by the continuations until the attempt is done, however it ends
+    std::shared_ptr<void> pending = pendingRequest();
+
+    // latency of the server, without the time spent waiting for a request slot
+    auto start = std::make_shared<std::chrono::steady_clock::time_point>();
+
+    return m_executor.acquire(host, laneOf(endpoint)).then([=]() {
+        // the wait for a slot counts against the deadline
+        *start = std::chrono::steady_clock::now();
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - *start);
+
+        if (left.count() <= 0)
+            throw http_exception("Deadline exceeded for " + url + query);
+
+        http_client_config config;
+        config.set_timeout(policy.attemptTimeout(attempt, maxAttempts, left));
+
+        if (!cred.username().empty())
+            config.set_credentials(cred);
+
+        // hold the slot until the body is in
+        return makeClient(url, config).request(req).then([](http_response response) {
+            return response.content_ready();
+        });
+    }).then([=, pending = pending](pplx::task<http_response> response)
+                    -> pplx::task<http_response> {
+        m_executor.release(host);
+
+        std::string failure;
+
+        try {
+            http_response r = response.get();
+
+            if (!isRetryable(r.status_code()) || attempt >= maxAttempts) {
+                server->m_latencies[endpoint].add(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - *start));
+                return pplx::task_from_result(r);
+            }
+
+            failure = "status " + std::to_string(r.status_code());
+        }
+        catch (const http_exception &e) {
+            if (attempt >= maxAttempts)
+                throw;
+
+            failure = e.what();
+        }
+        catch (const std::exception &e) {
+            // e.g. an invalid url, not worth a retry. Callers only expect failed requests
+            throw http_exception("Request " + url + query + " failed: " + e.what());
+        }
+
+        std::chrono::milliseconds pause = policy.backoff(attempt);
+
+        if (std::chrono::steady_clock::now() + pause >= deadline)
+            throw http_exception("Deadline exceeded for " + url + query + " (" + failure + ")");
+
+        m_metrics.m_retries++;
+
+        DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                   "Retrying " << url << query << " in " << pause.count() << " ms ("
+                               << failure << ")");
+
+        // the pause does not hold a thread, the next attempt counts as pending before this one
+        // lets go
+        return m_executor.delay(pause).then([=, pending = pending]() {
+            return sendGetRequest(server, endpoint, url, query, cred, deadline, attempt + 1,
+                                  maxAttempts);
+        });
+    });
+}
+
+pplx::task<http_response> INVENTREE_DRIVER::hedgeRequest(
+        pplx::task<http_response> primary, std::chrono::microseconds delay,
+        std::function<pplx::task<http_response>()> sendDuplicate) {
+    struct HEDGE_STATE {
+        std::atomic<bool> m_done{false};
+        std::atomic<int> m_sent{1};
+        std::atomic<int> m_failed{0};
+        pplx::task_completion_event<http_response> m_result;
+    };
+
+    std::shared_ptr<HEDGE_STATE> state = std::make_shared<HEDGE_STATE>();
+    std::atomic<size_t> *wins = &m_metrics.m_hedgeWins;
+
+    // the first answer wins, the request only fails once every copy has failed
+    auto settle = [state, wins](pplx::task<http_response> response, bool duplicate) {
+        try {
+            http_response r = response.get();
+
+            if (!state->m_done.exchange(true)) {
+                if (duplicate)
+                    (*wins)++;
+
+                state->m_result.set(r);
+            }
+        }
+        catch (...) {
+            if (++state->m_failed == state->m_sent && !state->m_done.exchange(true))
+                state->m_result.set_exception(std::current_exception());
+        }
     };
 
-    for (auto &s : selector) {
+    primary.then([settle](pplx::task<http_response> response) { settle(response, false); });
+
+    std::shared_ptr<void> pending = pendingRequest();
+
+    m_executor.delay(delay).then([this, state, settle, sendDuplicate, pending]() {
+        if (!state->m_done) {
+            state->m_sent++;
+            m_metrics.m_hedgedRequests++;
+
+            sendDuplicate().then([settle](pplx::task<http_response> response) {
+                settle(response, true);
+            });
+        }
+    });
+
+    return pplx::create_task(state->m_result);
+}
+
+bool INVENTREE_DRIVER::isRetryable(status_code code) {
+    return code == status_codes::RequestTimeout || code == status_codes::TooManyRequests ||
+           code == status_codes::InternalError || code == status_codes::BadGateway ||
+           code == status_codes::ServiceUnavailable || code == status_codes::GatewayTimeout;
+}
+
+void INVENTREE_DRIVER::beginRequest() {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    m_pendingRequests++;
+}
+
+void INVENTREE_DRIVER::endRequest() {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+    if (--m_pendingRequests == 0)
+        m_pendingDone.notify_all();
+}
+
+std::shared_ptr<void> INVENTREE_DRIVER::pendingRequest() {
+    beginRequest();
+
+    return std::shared_ptr<void>(nullptr, [this](void *) { endRequest(); });
+}
+
+void INVENTREE_DRIVER::waitForPendingRequests() {
+    // losing hedged requests and retries may still be in flight, all of them are bounded by
+    // their deadline
+    std::unique_lock<std::mutex> lock(m_pendingMutex);
+    m_pendingDone.wait(lock, [this] { return m_pendingRequests == 0; });
+}
+
+pplx::task<json::value> INVENTREE_DRIVER::postJSONRequest(const SERVER_PTR &server,
+                                                          const std::string &url,
+                                                          const json::value &body) {
+    const REQUEST_POLICY &policy = m_requestPolicies[_CREATE];
+    std::string host = server->m_serverURL;
+
+    http_client_config config;
+    config.set_timeout(policy.m_deadline);
+
+    web::http::http_request req(methods::POST);
+    req.headers().add("Authorization", "Token " + server->m_apiToken);
+
+    if (!m_acceptEncoding.empty())
+        req.headers().add(header_names::accept_encoding, m_acceptEncoding);
+
+    req.set_body(body);
+
+    return m_executor.acquire(host, REQUEST_EXECUTOR::_BACKGROUND).then([=]() {
+        // hold the slot until the body is in
+        return makeClient(url, config).request(req).then([](http_response response) {
+            return response.content_ready();
+        });
+    }).then([=](pplx::task<http_response> sent) -> pplx::task<json::value> {
+        m_executor.release(host);
+
+        http_response response = sent.get();
+        status_code status = response.status_code();
+
+        if (status == status_codes::Created || status == status_codes::OK)
+            return decodeJSONResponse(std::move(response), REQUEST_EXECUTOR::_BACKGROUND);
+
+        // the server explains what it did not like in the body, e.g. a missing field
+        return decodeJSONResponse(std::move(response), REQUEST_EXECUTOR::_BACKGROUND).then(
+                [=](pplx::task<json::value> error) -> json::value {
+                    std::string detail;
+
+                    try {
+                        detail = utility::conversions::to_utf8string(error.get().serialize());
+                    }
+                    catch (...) {
+                        // body is not JSON
+                    }
+
+                    throw http_exception("POST " + url + " failed with status " +
+                                         std::to_string(status) + " " + detail);
+                });
+    });
+}
+
+pplx::task<http_response> INVENTREE_DRIVER::conditionalGetRequest(const SERVER_PTR &server,
+                                                                  Endpoint endpoint,
+                                                                  const std::string &url,
+                                                                  const std::string &query,
+                                                                  const std::string &etag) {
+    const REQUEST_POLICY &policy = m_requestPolicies[endpoint];
+    std::string host = server->m_serverURL;
+    std::string projected = projectFields(server, endpoint, query);
+
+    http_client_config config;
+    config.set_timeout(policy.m_deadline);
+
+    web::http::http_request req(methods::GET);
+    req.headers().add("Authorization", "Token " + server->m_apiToken);
+
+    if (!m_acceptEncoding.empty())
+        req.headers().add(header_names::accept_encoding, m_acceptEncoding);
+
+    if (!etag.empty())
+        req.headers().add(header_names::if_none_match, etag);
+
+    if (!projected.empty())
+        req.set_request_uri(projected);
+
+    return m_executor.acquire(host, laneOf(endpoint)).then([=]() {
+        // hold the slot until the body is in
+        return makeClient(url, config).request(req).then([](http_response response) {
+            return response.content_ready();
+        });
+    }).then([=](pplx::task<http_response> sent) {
+        m_executor.release(host);
+
+        http_response response = sent.get();
+
+        // the next request asks for complete objects
+        if (response.status_code() == status_codes::BadRequest && projected != query) {
+            server->m_projectionRejected[endpoint] = true;
+
+            DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                       "Field projection not supported by " << url
+                                                            << ", requesting all fields");
+        }
+
+        return response;
+    });
+}
+
+/***** Stock watch ********/
+void INVENTREE_DRIVER::startStockWatch() {
+    for (size_t idx = 0; idx < m_servers.size(); idx++) {
+        const SERVER_PTR &server = m_servers[idx];
+
+        if (!server->m_stockWebsocketURL.empty() && !server->m_offline)
+            connectStockSocket(server, static_cast<int>(idx));
+    }
+
+    if (m_stockPollInterval.count() == 0)
+        return;
+
+    m_stockPollStop = false;
+    m_stockPoller = std::thread([this]() { runStockPoller(); });
+}
+
+void INVENTREE_DRIVER::stopStockWatch() {
+    {
+        std::lock_guard<std::mutex> lock(m_stockPollMutex);
+        m_stockPollStop = true;
+    }
+
+    m_stockPollWake.notify_all();
+
+    if (m_stockPoller.joinable())
+        m_stockPoller.join();
+
+    for (const auto &server : m_servers) {
+        if (!server->m_stockSocket)
+            continue;
+
+        // messages which are still delivered are dropped
+        server->m_stockPushed = false;
+
+        try {
+            server->m_stockSocket->close().wait();
+        }
+        catch (std::exception const &e) {
+            DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "stopStockWatch(): " << e.what());
+        }
+
+        server->m_stockSocket.reset();
+    }
+}
+
+void INVENTREE_DRIVER::runStockPoller() {
+    std::unique_lock<std::mutex> lock(m_stockPollMutex);
+
+    while (!m_stockPollWake.wait_for(lock, m_stockPollInterval,
+                                     [this]() { return m_stockPollStop; })) {
+        lock.unlock();
+
+        {
+            // connectToWarehouse(...) stops the poller while it holds the lock exclusively, the
+            // round is skipped instead of waiting for it
+            std::shared_lock<std::shared_timed_mutex> connection(m_connectionMutex,
+                                                                 std::try_to_lock);
+
+            if (connection.owns_lock() && !m_stockWatch.empty()) {
+                std::vector<pplx::task<void>> polls;
+
+                for (size_t idx = 0; idx < m_servers.size(); idx++)
+                    polls.push_back(pollStock(m_servers[idx], static_cast<int>(idx)));
+
+                pplx::when_all(polls.begin(), polls.end()).wait();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+pplx::task<void> INVENTREE_DRIVER::pollStock(const SERVER_PTR &server, int serverIdx) {
+    std::vector<int> pks = m_stockWatch.parts(serverIdx);
+
+    if (pks.empty() || server->m_offline || server->m_stockPushed)
+        return pplx::task_from_result();
+
+    // one request for all parts, the limit bounds the answer of a server ignoring the filter
+    std::vector<std::pair<std::string, std::string>> polls;
+
+    if (!server->m_stockFilterIgnored) {
+        std::string list;
+        for (int pk : pks)
+            list += (list.empty() ? "" : ",") + std::to_string(pk);
+
+        polls.emplace_back(server->m_apiURL + "part/",
+                           "?pk__in=" + uri::encode_data_string(list) + "&limit=" +
+                           std::to_string(pks.size()));
+    } else {
+        for (int pk : pks)
+            polls.emplace_back(server->m_apiURL + "part/" + std::to_string(pk) + "/", "");
+    }
+
+    std::vector<pplx::task<void>> requests;
+
+    for (const auto &poll : polls) {
+        std::string key = poll.first + poll.second;
+
+        m_metrics.m_stockPolls++;
+
+        requests.push_back(
+                conditionalGetRequest(server, _STOCK, poll.first, poll.second,
+                                      m_stockWatch.etag(key))
+                        .then([=](http_response response) -> pplx::task<void> {
+                            if (response.status_code() == status_codes::NotModified) {
+                                m_metrics.m_stockNotModified++;
+                                return pplx::task_from_result();
+                            }
+
+                            if (response.status_code() != status_codes::OK)
+                                return pplx::task_from_result();
+
+                            utility::string_t etag;
+                            response.headers().match(header_names::etag, etag);
+
+                            return decodeJSONResponse(std::move(response),
+                                                      REQUEST_EXECUTOR::_BACKGROUND)
+                                    .then([=](json::value obj) {
+                                        applyStockLevels(server, serverIdx, obj, pks);
+
+                                        // only once the answer has been applied
+                                        m_stockWatch.setEtag(
+                                                key, utility::conversions::to_utf8string(etag));
+                                    });
+                        })
+                        .then([=](pplx::task<void> done) {
+                            try {
+                                done.get();
+                            }
+                            catch (std::exception const &e) {
+                                // the next round asks again
+                                DRIVER_LOG(INVENTREE_LOGGER::_DEBUG,
+                                           "pollStock(): " << server->m_tag << ": "
+                                                           << e.what());
+                            }
+                        }));
+    }
+
+    return pplx::when_all(requests.begin(), requests.end());
+}
+
+void INVENTREE_DRIVER::connectStockSocket(const SERVER_PTR &server, int serverIdx) {
+    using namespace web::websockets::client;
+
+    websocket_client_config config;
+    config.headers().add("Authorization", "Token " + server->m_apiToken);
+
+    server->m_stockSocket.reset(new websocket_callback_client(config));
+
+    // the server owns the socket, its handlers must not keep the server alive
+    std::weak_ptr<SERVER_CONNECTION> weakServer = server;
+
+    server->m_stockSocket->set_message_handler(
+            [this, weakServer, serverIdx](const websocket_incoming_message &message) {
+                SERVER_PTR pushing = weakServer.lock();
+                if (!pushing || !pushing->m_stockPushed)
+                    return;
+
+                // stopStockWatch(...) holds the lock exclusively while it closes the socket
+                std::shared_lock<std::shared_timed_mutex> connection(m_connectionMutex,
+                                                                     std::try_to_lock);
+                if (!connection.owns_lock())
+                    return;
+
+                try {
+                    json::value obj = json::value::parse(
+                            utility::conversions::to_string_t(message.extract_string().get()));
+
+                    applyStockLevels(pushing, serverIdx, obj, std::vector<int>());
+                }
+                catch (std::exception const &e) {
+                    DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                               "Invalid stock message from " << pushing->m_tag << ": "
+                                                             << e.what());
+                }
+            });
+
+    server->m_stockSocket->set_close_handler(
+            [weakServer](websocket_close_status, const utility::string_t &,
+                         const std::error_code &) {
+                // polling takes over
+                SERVER_PTR closed = weakServer.lock();
+                if (closed)
+                    closed->m_stockPushed = false;
+            });
+
+    try {
+        server->m_stockSocket->connect(uri(utility::conversions::to_string_t(
+                server->m_stockWebsocketURL))).wait();
+        server->m_stockPushed = true;
+    }
+    catch (std::exception const &e) {
+        DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                   "Stock websocket " << server->m_stockWebsocketURL
+                                      << " can not be opened, polling instead: " << e.what());
+        server->m_stockSocket.reset();
+    }
+}
+
+void INVENTREE_DRIVER::applyStockLevels(const SERVER_PTR &server, int serverIdx,
+                                        const json::value &obj,
+                                        const std::vector<int> &requested) {
+    const json::value *list = &obj;
+
+    if (obj.is_object() && obj.has_field(U("results")))
+        list = &obj.at(U("results"));
+
+    std::vector<const json::value *> parts;
+    if (list->is_array()) {
+        for (const auto &part : list->as_array())
+            parts.push_back(&part);
+    } else if (list->is_object()) {
+        parts.push_back(list);
+    }
+
+    for (const json::value *item : parts) {
+        const json::value &part = *item;
+
+        if (!part.has_field(U("pk")) || !part.at(U("pk")).is_integer() ||
+            !part.has_field(U("in_stock")))
+            continue;
+
+        int pk = part.at(U("pk")).as_integer();
+
+        // the server does not know the pk__in filter, the parts are polled one by one instead
+        if (!requested.empty() &&
+            std::find(requested.begin(), requested.end(), pk) == requested.end()) {
+            if (!server->m_stockFilterIgnored.exchange(true))
+                DRIVER_LOG(INVENTREE_LOGGER::_INFO,
+                           server->m_tag << " ignores the pk__in filter, polling parts singly");
+            continue;
+        }
+
+        publishStockLevel(serverIdx, pk, removeQuotationMarks(part.at(U("in_stock")).serialize()));
+    }
+}
+
+void INVENTREE_DRIVER::publishStockLevel(int serverIdx, int pk, const wxString &inStock) {
+    if (!m_stockWatch.update(serverIdx, pk, inStock))
+        return;
+
+    m_metrics.m_stockChanges++;
+
+    // the part has changed on the server since the result sets were cached
+    m_searchCache.invalidate(serverIdx, pk);
+
+    std::shared_ptr<const std::vector<FOUND_PART>> foundParts = std::atomic_load(&m_foundParts);
+
+    int listPos = -1;
+    for (size_t i = 0; i < foundParts->size(); i++) {
+        if ((*foundParts)[i].m_server == serverIdx && (*foundParts)[i].m_pk == pk) {
+            listPos = static_cast<int>(i);
+            break;
+        }
+    }
+
+    DRIVER_LOG(INVENTREE_LOGGER::_DEBUG, "Stock of part " << pk << " changed to " << inStock);
+
+    std::map<wxString, wxString> delta;
+    delta[formatNameString("in_stock")] = inStock;
+
+    if (fCallbackStockUpdates)
+        fCallbackStockUpdates(listPos, delta, m_driverID);
+}
+
+/***** General evaluation functions ********/
+pplx::task<json::value> INVENTREE_DRIVER::evaluateServerResponse(http_response response,
+                                                                 REQUEST_EXECUTOR::Lane lane) {
+    if (response.status_code() == status_codes::OK) {
+        return decodeJSONResponse(std::move(response), lane);
+    }
+
+//    fCallbackDisplayStatusMessage(
+//            wxString::Format("Error during communication with InvenTree.\nError Code: %d ( %s )",
+//                             response.status_code(), response.reason_phrase()),
+//            "Server Response", IWareHouse::Display::_ERROR_DIALOG);
+
+    return pplx::task_from_result(json::value());
+}
+
+pplx::task<json::value> INVENTREE_DRIVER::decodeJSONResponse(http_response response,
+                                                             REQUEST_EXECUTOR::Lane lane) {
+    utility::string_t encoding;
+    response.headers().match(header_names::content_encoding, encoding);
+
+    DRIVER_METRICS *metrics = &m_metrics;
+
+    // read the raw body, so the size on the wire is known before it is decoded
+    return response.extract_vector().then([=](std::vector<unsigned char> body) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::string text;
+        if (encoding.empty() || encoding == U("identity")) {
+            text.assign(body.begin(), body.end());
+        } else {
+            text = decompressBody(encoding, body);
+            metrics->m_compressedResponses++;
+        }
+
+        json::value obj = json::value::parse(utility::conversions::to_string_t(text));
+
+        long long micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+        metrics->m_responses++;
+        metrics->m_wireBytes += body.size();
+        metrics->m_decodedBytes += text.size();
+        metrics->m_decodeMicros += micros;
+
+        DRIVER_LOG(INVENTREE_LOGGER::_TRACE,
+                   body.size() << " byte(s) received, " << text.size() << " byte(s) "
+                               << (encoding.empty() ? "plain" : encoding) << ", decoded in "
+                               << micros << " us");
+
+        return obj;
+    }, pplx::task_options(m_executor.scheduler(lane)));
+}
+
+std::string INVENTREE_DRIVER::decompressBody(const utility::string_t &encoding,
+                                             const std::vector<unsigned char> &body) {
+    std::unique_ptr<compression::decompress_provider> decompressor =
+            compression::builtin::make_decompressor(encoding);
+
+    if (!decompressor)
+        throw http_exception("Unsupported content encoding: " + encoding);
+
+    std::string text;
+    std::vector<uint8_t> chunk(64 * 1024);
+    size_t offset = 0;
+    bool done = false;
+
+    while (!done) {
+        size_t used = 0;
+        size_t produced = decompressor->decompress(body.data() + offset, body.size() - offset,
+                                                   chunk.data(), chunk.size(),
+                                                   compression::operation_hint::is_last, used,
+                                                   done);
+
+        text.append(reinterpret_cast<const char *>(chunk.data()), produced);
+        offset += used;
+
+        // truncated input, the JSON parser will report it
+        if (produced == 0 && used == 0)
+            break;
+    }
+
+    return text;
+}
+
+std::map<std::string, double> INVENTREE_DRIVER::metrics() const {
+    return m_metrics.snapshot();
+}
+
+json::value INVENTREE_DRIVER::evaluateJSONResponse(pplx::task<json::value> jsonResponse) {
+    json::value obj = jsonResponse.get();
+    if (!obj.is_null()) {
+        return obj;
+    }
+
+//    fCallbackDisplayStatusMessage(
+//            "Server did not respond as expected. Not sure what to do... I think I am cooked... I am so sorry...",
+//            "Server Response", IWareHouse::Display::_ERROR_DIALOG);
+
+    return json::value();
+}
+
+bool INVENTREE_DRIVER::configureTrafficCapture(std::map<wxString, wxString> &args) {
+    m_trafficMode = _TRAFFIC_LIVE;
+    m_traffic.reset();
+    m_trafficLatencyScale = 1.0;
+
+    if (!args["traffic_replay"].empty()) {
+        m_traffic = TRAFFIC_FILE::openForReplay(args["traffic_replay"].ToStdString());
+
+        if (!m_traffic) {
+            DRIVER_LOG(INVENTREE_LOGGER::_ERROR,
+                       "Failed to load traffic capture " << args["traffic_replay"]);
+            return false;
+        }
+
+        if (!args["traffic_replay_scale"].empty())
+            args["traffic_replay_scale"].ToDouble(&m_trafficLatencyScale);
+
+        m_trafficMode = _TRAFFIC_REPLAY;
+
+        DRIVER_LOG(INVENTREE_LOGGER::_INFO, "Replaying " << m_traffic->size()
+                                                        << " recorded response(s) from "
+                                                        << args["traffic_replay"]);
+    } else if (!args["traffic_record"].empty()) {
+        m_traffic = TRAFFIC_FILE::openForRecording(args["traffic_record"].ToStdString());
+
+        // recording is a diagnostic aid, carry on without it
+        if (m_traffic)
+            m_trafficMode = _TRAFFIC_RECORD;
+        else
+            DRIVER_LOG(INVENTREE_LOGGER::_WARNING,
+                       "Failed to create traffic capture " << args["traffic_record"]);
+    }
+
+    return true;
+}
+
+http_client INVENTREE_DRIVER::makeClient(const std::string &url, const http_client_config &config) {
+    http_client client(url, config);
+
+    // pipeline stages are chained per client and can therefore not be shared
+    if (m_trafficMode == _TRAFFIC_RECORD)
+        client.add_handler(std::make_shared<TRAFFIC_RECORD_STAGE>(m_traffic));
+    else if (m_trafficMode == _TRAFFIC_REPLAY)
+        client.add_handler(
+                std::make_shared<TRAFFIC_REPLAY_STAGE>(m_traffic, m_trafficLatencyScale,
+                                                       m_executor));
+
+    return client;
+}
+
+void INVENTREE_DRIVER::configureRequestPolicies(std::map<wxString, wxString> &args) {
+    const char *names[_ENDPOINT_COUNT] = {"version", "token", "search", "detail", "parameters",
+                                          "image", "templates", "locations", "create", "catalog",
+                                          "stock", "library", "categories", "partnumbers"};
+
+    bool hedge = args["hedge_requests"] == "1" || args["hedge_requests"].Lower() == "true";
+
+    // negotiate every encoding cpprest was built with, unless compression=off
+    m_acceptEncoding.clear();
+
+    if (args["compression"].Lower() != "off" && compression::builtin::supported()) {
+        const utility::char_t *algorithms[] = {compression::builtin::algorithm::BROTLI,
+                                               compression::builtin::algorithm::GZIP,
+                                               compression::builtin::algorithm::DEFLATE};
+
+        for (auto algorithm : algorithms) {
+            if (!compression::builtin::algorithm::supported(algorithm))
+                continue;
+
+            if (!m_acceptEncoding.empty())
+                m_acceptEncoding += U(", ");
+
+            m_acceptEncoding += algorithm;
+        }
+    }
+
+    for (int e = 0; e < _ENDPOINT_COUNT; e++) {
+        REQUEST_POLICY &policy = m_requestPolicies[e];
+        wxString name = names[e];
+        long value;
+
+        if (args[name + "_deadline_ms"].ToLong(&value) && value > 0)
+            policy.m_deadline = std::chrono::milliseconds(value);
+
+        if (args[name + "_retries"].ToLong(&value) && value >= 0)
+            policy.m_maxRetries = static_cast<int>(value);
+
+        if (args["request_timeout_ms"].ToLong(&value) && value > 0)
+            policy.m_attemptTimeout = std::chrono::milliseconds(value);
+
+        // only interactive lookups are worth the extra load of duplicate requests
+        policy.m_hedge = hedge && (e == _PART_SEARCH || e == _PART_DETAIL || e == _PART_PARAMETERS);
+    }
+}
+
+void INVENTREE_DRIVER::configureFieldProjection(std::map<wxString, wxString> &args) {
+    if (!args["visible_attributes"].empty())
+        m_visibleAttributes = splitList(args["visible_attributes"]);
+
+    // everything the detail view shows, plus what the driver itself needs
+    wxString detailFields;
+    for (const auto &attribute : m_visibleAttributes)
+        detailFields += (detailFields.empty() ? "" : ",") + attribute;
+
+    m_projectedFields[_PART_SEARCH] =
+            "pk,name,IPN,revision,description,keywords,tags,image,category";
+    m_projectedFields[_PART_DETAIL] = detailFields.ToStdString();
+    m_projectedFields[_PART_PARAMETERS] = "pk,part,template,data";
+    m_projectedFields[_PARAMETER_TEMPLATES] = "pk,name,units";
+    m_projectedFields[_STOCK_LOCATIONS] = "pk,parent,items,url,name,description,pathstring";
+    m_projectedFields[_PART_CATEGORIES] = "pk,parent,name,description";
+
+    const char *overrides[][2] = {{"fields_search",     "search"},
+                                  {"fields_detail",     "detail"},
+                                  {"fields_parameters", "parameters"},
+                                  {"fields_templates",  "templates"},
+                                  {"fields_locations",  "locations"},
+                                  {"fields_categories", "categories"}};
+    const Endpoint endpoints[] = {_PART_SEARCH, _PART_DETAIL, _PART_PARAMETERS,
+                                  _PARAMETER_TEMPLATES, _STOCK_LOCATIONS, _PART_CATEGORIES};
+
+    for (size_t i = 0; i < 6; i++) {
+        if (args.count(overrides[i][0]))
+            m_projectedFields[endpoints[i]] = args[overrides[i][0]].ToStdString();
+    }
+
+    // a snapshot keeps what a search needs
+    m_projectedFields[_CATALOG] = m_projectedFields[_PART_SEARCH];
+
+    m_projectedFields[_STOCK] = "pk,in_stock";
+
+    // parts, manufacturer parts and supplier parts share the endpoint
+    m_projectedFields[_PART_NUMBERS] = "pk,part,IPN,MPN,SKU";
+
+    m_fieldProjection = args["field_projection"].Lower() != "off";
+}
+
+void INVENTREE_DRIVER::configureSearchCache(std::map<wxString, wxString> &args) {
+    long size = 32;
+    long ttl = 60;
+    long limit = 0;
+
+    if (!args["search_cache_size"].empty() && !args["search_cache_size"].ToLong(&size))
+        size = 32;
+
+    if (!args["search_cache_ttl_s"].empty() && !args["search_cache_ttl_s"].ToLong(&ttl))
+        ttl = 60;
+
+    if (!args["search_limit"].empty() && !args["search_limit"].ToLong(&limit))
+        limit = 0;
+
+    // also drops the result sets of the previous connection
+    m_searchCache.configure(static_cast<size_t>(std::max(size, 0L)),
+                            std::chrono::seconds(std::max(ttl, 0L)));
+    m_searchLimit = static_cast<int>(std::max(limit, 0L));
+}
+
+void INVENTREE_DRIVER::configurePartCreation(std::map<wxString, wxString> &args) {
+    long value;
+
+    m_bulkParallelism = 4;
+    m_defaultCategory = -1;
+
+    // every lane occupies a pplx worker while it waits for its requests
+    if (args["bulk_parallelism"].ToLong(&value) && value > 0)
+        m_bulkParallelism = static_cast<int>(std::min(value, 16L));
+
+    if (args["default_category"].ToLong(&value) && value > 0)
+        m_defaultCategory = static_cast<int>(value);
+}
+
+void INVENTREE_DRIVER::configureExecutor(std::map<wxString, wxString> &args) {
+    long threads = 4;
+    long hostConcurrency = 6;
+
+    if (!args["executor_threads"].empty() && !args["executor_threads"].ToLong(&threads))
+        threads = 4;
+
+    if (!args["host_concurrency"].empty() && !args["host_concurrency"].ToLong(&hostConcurrency))
+        hostConcurrency = 6;
+
+    // no request or decoding is running, connectToWarehouse(...) has waited for them
+    m_executor.configure(static_cast<size_t>(std::min(std::max(threads, 1L), 32L)),
+                         static_cast<size_t>(std::min(std::max(hostConcurrency, 1L), 64L)));
+}
+
+REQUEST_EXECUTOR::Lane INVENTREE_DRIVER::laneOf(Endpoint endpoint) {
+    return endpoint == _CREATE || endpoint == _CATALOG || endpoint == _STOCK ||
+           endpoint == _LIBRARY || endpoint == _PART_NUMBERS ? REQUEST_EXECUTOR::_BACKGROUND
+                                                             : REQUEST_EXECUTOR::_INTERACTIVE;
+}
+
+void INVENTREE_DRIVER::configureSnapshots(std::map<wxString, wxString> &args) {
+    long age;
+
+    m_snapshotMaxAge = std::chrono::hours(24);
+
+    if (args["snapshot_max_age_s"].ToLong(&age) && age >= 0)
+        m_snapshotMaxAge = std::chrono::seconds(age);
+}
+
+void INVENTREE_DRIVER::configureLibrary(std::map<wxString, wxString> &args) {
+    m_libraryFile = args["library_file"].ToStdString();
+    m_libraryDescriptionFile = args["library_description_file"].ToStdString();
+    m_libraryName = args["library_name"].empty() ? "InvenTree"
+                                                 : args["library_name"].ToStdString();
+}
+
+void INVENTREE_DRIVER::configurePartNumbers(std::map<wxString, wxString> &args) {
+    wxString value = args["part_number_index"].Lower();
+    m_partNumberIndex = value == "on" || value == "1" || value == "true";
+
+    // the tables refer to the servers which are replaced now
+    m_partNumbers.clear();
+}
+
+void INVENTREE_DRIVER::configureStockWatch(std::map<wxString, wxString> &args) {
+    long size = 16;
+    long interval = 0;
+
+    if (!args["stock_watch_size"].empty() && !args["stock_watch_size"].ToLong(&size))
+        size = 16;
+
+    if (!args["stock_poll_s"].empty() && !args["stock_poll_s"].ToLong(&interval))
+        interval = 0;
+
+    // also forgets the parts watched on the previous servers
+    m_stockWatch.configure(static_cast<size_t>(std::min(std::max(size, 0L), 256L)));
+    m_stockPollInterval = std::chrono::seconds(std::max(interval, 0L));
+}
+
+std::vector<wxString> INVENTREE_DRIVER::splitList(const wxString &list) {
+    std::vector<wxString> items;
+    wxString item;
+
+    for (size_t i = 0; i <= list.length(); i++) {
+        if (i == list.length() || list[i] == ',') {
+            item.Trim(true).Trim(false);
+
+            if (!item.empty())
+                items.push_back(item);
+
+            item.clear();
+        } else {
+            item += list[i];
+        }
+    }
+
+    return items;
+}
+
+void INVENTREE_DRIVER::configureLogger(std::map<wxString, wxString> &args) {
+    // runs before the arguments are checked, so it must not add any to them
+    auto levelArg = args.find("log_level");
+    auto sinkArg = args.find("log_sink");
+    auto fileArg = args.find("log_file");
+
+    INVENTREE_LOGGER::Level level = INVENTREE_LOGGER::_INFO;
+    if (levelArg != args.end())
+        level = INVENTREE_LOGGER::levelFromString(levelArg->second);
+
+    // the status callback belongs to this instance, the process wide sinks are left alone
+    if (sinkArg != args.end() && INVENTREE_STATUS_LOG::isStatusSink(sinkArg->second)) {
+        m_statusLog.setLevel(level);
+        return;
+    }
+
+    m_statusLog.setLevel(INVENTREE_LOGGER::_OFF);
+
+    // logging stays disabled unless a sink has been selected explicitly
+    if (levelArg != args.end())
+        INVENTREE_LOGGER::instance().setLevel(level);
+
+    if (sinkArg != args.end()) {
+        std::string file = fileArg != args.end() ? fileArg->second.ToStdString() : "";
+
+        if (!INVENTREE_LOGGER::instance().setSink(
+                INVENTREE_LOGGER::sinkFromString(sinkArg->second), file))
+            INVENTREE_LOGGER::instance().setSink(INVENTREE_LOGGER::_SINK_OFF);
+    }
+}
+
+wxString INVENTREE_DRIVER::removeQuotationMarks(std::string str) {
+    // Check if " is present in first position and if so delete the on at the front and at the end
+    // of the string
+    if (str.find('\"') == 0) {
+        str.erase(str.begin());
+        str.erase(str.end() - 1);
+    }
+
+    return str;
+}
+
+bool INVENTREE_DRIVER::visibleAttributes(const wxString &term) {
+    for (auto &s : m_visibleAttributes) {
         if (s == term)
             return true;
     }
@@ -689,6 +2925,26 @@ bool INVENTREE_DRIVER::visibleAttributes(const wxString &term) {
     return false;
 }
 
+wxString INVENTREE_DRIVER::stringField(const json::value &obj, const utility::string_t &name) {
+    if (!obj.is_object() || !obj.has_field(name))
+        return "";
+
+    const json::value &field = obj.at(name);
+
+    if (field.is_string())
+        return field.as_string();
+
+    // e.g. a part without image is reported as null
+    return field.is_null() ? "" : removeQuotationMarks(field.serialize());
+}
+
+wxString INVENTREE_DRIVER::normalizeKey(wxString key) {
+    key.Replace("_", " ");
+    key.Trim(true).Trim(false);
+
+    return key.Lower();
+}
+
 wxString INVENTREE_DRIVER::formatNameString(wxString text) {
     text.Replace("_", " ");
 
@@ -717,15 +2973,33 @@ wxString INVENTREE_DRIVER::driverVersion() {
 
 /***** Callback functions ********/
 void INVENTREE_DRIVER::CallbackForFoundParts(std::function<void(std::vector<wxString>, int)> f) {
+    std::unique_lock<std::shared_timed_mutex> lock(m_connectionMutex);
     fCallbackDisplayFoundParts = f;
 }
 
 void INVENTREE_DRIVER::CallbackForPartDetails(std::function<void(std::map<wxString, wxString>, int)> f) {
+    std::unique_lock<std::shared_timed_mutex> lock(m_connectionMutex);
     fCallbackDisplayPartParameters = f;
 }
 
+void INVENTREE_DRIVER::CallbackForStockUpdates(
+        std::function<void(int, std::map<wxString, wxString>, int)> f) {
+    std::unique_lock<std::shared_timed_mutex> lock(m_connectionMutex);
+    fCallbackStockUpdates = f;
+}
+
 void INVENTREE_DRIVER::CallbackForStatusMessage(
         std::function<void(const wxString &, const wxString &, IWareHouse::Display)> f) {
+    std::unique_lock<std::shared_timed_mutex> lock(m_connectionMutex);
     fCallbackDisplayStatusMessage = f;
+
+    // the status sink forwards into KiCad's console
+    if (f) {
+        m_statusLog.setCallback([f](const wxString &msg, const wxString &title) {
+            f(msg, title, IWareHouse::Display::_CONSOLE);
+        });
+    } else {
+        m_statusLog.setCallback(nullptr);
+    }
 }
 
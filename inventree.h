@@ -19,6 +19,26 @@
 
 // Import the standardised interface
 #include "IWareHouse.h"
+#include "logger.h"
+#include "traffic_capture.h"
+#include "request_policy.h"
+#include "driver_metrics.h"
+#include "search_cache.h"
+#include "catalog_snapshot.h"
+#include "request_executor.h"
+#include "stock_watch.h"
+#include "shared_registry.h"
+#include "hierarchy_index.h"
+#include "part_number_index.h"
+#include "sqlite_library.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 
 #include <functional>
 #include <cstdio>
@@ -30,6 +50,7 @@
 #include <curl/curl.h>
 
 #include <cpprest/http_client.h>
+#include <cpprest/http_compression.h>
 #include <cpprest/filestream.h>
 #include <cpprest/http_listener.h>   // HTTP server
 #include <cpprest/json.h>            // JSON library
@@ -76,6 +97,60 @@ struct STOCK_LOCATION {
 };
 
 
+/**
+ * A part category from InvenTree, categories form a tree through their parent
+ */
+struct PART_CATEGORY {
+    PART_CATEGORY(int pk, int parent, wxString name, wxString description) {
+        m_pk = pk;
+        m_parent = parent;
+        m_name = name;
+        m_description = description;
+    }
+
+    int m_pk;
+    int m_parent;
+    wxString m_name;
+    wxString m_description;
+};
+
+typedef HIERARCHY_INDEX<PART_CATEGORY> CATEGORY_INDEX;
+
+
+/**
+ * The stock locations of a server as a tree. InvenTree already counts the stock items of a
+ * location including all locations below it, so the counts are used as they are
+ */
+class STOCK_LOCATION_INDEX : public HIERARCHY_INDEX<STOCK_LOCATION> {
+public:
+    explicit STOCK_LOCATION_INDEX(std::vector<STOCK_LOCATION> locations)
+            : HIERARCHY_INDEX<STOCK_LOCATION>(std::move(locations)) {}
+
+    // @return the stock items of the location and all locations below it, 0 for an unknown pk
+    long subtreeItems(int pk) const {
+        // locations without a count are taken as empty
+        const STOCK_LOCATION *location = find(pk);
+        return location ? std::max(location->m_items, 0) : 0;
+    }
+
+    /*!
+      Describes the stock along the path to a location, e.g. "Building: 120, Room 2: 40,
+      Shelf 3: 5", every location with the items of its subtree
+      @return an empty string for an unknown pk
+      */
+    wxString rollUpText(int pk) const {
+        wxString text;
+
+        for (const STOCK_LOCATION *location : ancestors(pk)) {
+            text += (text.empty() ? "" : ", ") + location->m_name + ": " +
+                    wxString(std::to_string(subtreeItems(location->m_pk)));
+        }
+
+        return text;
+    }
+};
+
+
 /**
  * A structure to represent a part parameter template from Inventree
  * The api responses with a JSON structure which is captured in this struct.
@@ -93,6 +168,31 @@ struct TEMPLATE_PARAMETER {
     wxString m_units;
 };
 
+/**
+ * Parameter templates, stock locations and part categories of a server, shared by all driver
+ * instances of the process which connect to the server as the same user
+ */
+struct REFERENCE_DATA {
+    // immutable snapshots which are replaced as a whole, only access them through
+    // std::atomic_load(...) and std::atomic_store(...)
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> m_parameterTemplates =
+            std::make_shared<const std::vector<TEMPLATE_PARAMETER>>();
+    std::shared_ptr<const STOCK_LOCATION_INDEX> m_stockLocations =
+            std::make_shared<const STOCK_LOCATION_INDEX>(std::vector<STOCK_LOCATION>());
+    std::shared_ptr<const CATEGORY_INDEX> m_partCategories =
+            std::make_shared<const CATEGORY_INDEX>(std::vector<PART_CATEGORY>());
+
+    // held while the data is loaded, instances connecting meanwhile wait and attach to it
+    std::mutex m_loadMutex;
+    bool m_loaded = false;
+
+    // categories are not kept in catalog snapshots, they are loaded on their own
+    bool m_categoriesLoaded = false;
+
+    // serializes changes of the snapshots above, e.g. templates created by several instances
+    std::mutex m_updateMutex;
+};
+
 /**
  * A structure to represent a part parameter from Inventree
  * The api responses with a JSON structure which is captured in this struct.
@@ -103,10 +203,11 @@ struct PART_PARAMETER {
  * @param tp list with all available template parameters
  * @param pk primary key of template parameter
  */
-    std::map<wxString, wxString> findTemplateName(std::vector<TEMPLATE_PARAMETER> tp, int pk) {
+    std::map<wxString, wxString> findTemplateName(const std::vector<TEMPLATE_PARAMETER> &tp,
+                                                  int pk) {
         std::map<wxString, wxString> map;
 
-        for (auto &t : tp) {
+        for (const auto &t : tp) {
             if (t.m_pk == pk) {
                 map["name"] = t.m_name;
                 map["units"] = t.m_units;
@@ -119,7 +220,7 @@ struct PART_PARAMETER {
 
     // this struct is a template of the api response when querying locations
     PART_PARAMETER(int pk, int part, int template_pk, wxString data,
-                   std::vector<TEMPLATE_PARAMETER> partTemplates) {
+                   const std::vector<TEMPLATE_PARAMETER> &partTemplates) {
         // get name and units associated with template pk
         std::map<wxString, wxString> temp = findTemplateName(partTemplates, template_pk);
         m_template = temp["name"];
@@ -143,41 +244,25 @@ struct PART_PARAMETER {
  * The api responses with a JSON structure which is captured in this struct.
  */
 struct PART_ATTRIBUTE {
-    /**
-    * Search function to get the name
-    * @param tp list with all available template parameters
-    * @param pk primary key of template parameter
-    */
-    std::map<wxString, wxString> findLocationDescription(std::vector<STOCK_LOCATION> sL, int pk) {
-        std::map<wxString, wxString> map;
-
-        for (auto &t : sL) {
-            if (t.m_pk == pk) {
-                map["name"] = t.m_name;
-                map["description"] = t.m_description;
-                break;
-            }
-        }
-
-        return map;
-    };
-
     // this struct is a template of the api response when querying locations
-    PART_ATTRIBUTE(wxString name, wxString value, std::vector<STOCK_LOCATION> stockLocations) {
+    PART_ATTRIBUTE(wxString name, wxString value,
+                   const STOCK_LOCATION_INDEX *stockLocations = nullptr,
+                   const CATEGORY_INDEX *categories = nullptr) {
         m_name = name;
         m_value = value;
 
         try {
-            if (name == "default_location") {
-                std::map<wxString, wxString> loc = findLocationDescription(
-                        std::move(stockLocations), atoi(value.c_str()));
-
-                m_value = loc["name"] + " ->> " + loc["description"];
-            } else if (name == "category") {
-                //            std::map<wxString, wxString> loc =
-                //                    findLocationDescription( stockLocations, atoi( value.c_str() ) );
-                //
-                //            m_value = loc["name"] + ":" + loc["description"];
+            const STOCK_LOCATION *location = nullptr;
+
+            if (name == "default_location" && stockLocations &&
+                (location = stockLocations->find(atoi(value.c_str())))) {
+                m_value = stockLocations->path(location->m_pk) + " ->> " +
+                          location->m_description;
+            } else if (name == "category" && categories) {
+                wxString path = categories->path(atoi(value.c_str()));
+
+                if (!path.empty())
+                    m_value = path;
             }
         }
         catch (...) {
@@ -193,10 +278,12 @@ struct PART_ATTRIBUTE {
 /*!
   Downloads an image from a specified online source and saves it in a dummy file locally
   @param[in] url URL to image source
+  @param[in] timeoutMs maximum duration of the transfer, 0 waits forever
+  @param[out] wireBytes number of (possibly compressed) bytes transferred
   @return bool returns true if file was downloaded and saved successfully
   @author Andre Iwers
   */
-bool downloadImagesFile(std::string url);
+bool downloadImagesFile(std::string url, long timeoutMs = 0, size_t *wireBytes = nullptr);
 
 
 /*!
@@ -208,6 +295,13 @@ size_t callbackFunctionWriteFile(void *ptr, size_t size, size_t nmemb, void *use
 
 /*! This Interface allows KiCAD to communicate with Inventree and open-source warehouse application
  * Inventree GitHub project can be found here:  https://github.com/inventree
+ *
+ * Several InvenTree servers can be connected at once, searches are then sent to all of them and
+ * the results are merged.
+ *
+ * The driver may be used from several threads at once. connectToWarehouse(...) and the callback
+ * setters run exclusively, all other calls run concurrently. The callbacks are invoked from the
+ * calling thread, a pplx worker or the stock poller and must not call back into the driver.
  * */
 class INVENTREE_DRIVER : public IWareHouse {
 public:
@@ -215,7 +309,151 @@ public:
 
     virtual ~INVENTREE_DRIVER() override;
 
+    /*!
+      Returns the driver's counters, e.g. bytes on the wire, decoding time, retries
+      @return counter name -> value
+      */
+    std::map<std::string, double> metrics() const;
+
+    /*!
+      Creates several parts concurrently, at most "bulk_parallelism" (connection argument,
+      default 4) at a time. Parts are created on the first connected server
+      @param[in] parts one parameter map per part, as passed to addPartToWareHouse(...)
+      @param[in] progress called after each part with the number of parts done and the total,
+                 from any thread
+      @return number of parts which were created with all their parameters
+      */
+    size_t addPartsToWareHouse(const std::vector<std::map<wxString, wxString>> &parts,
+                               std::function<void(size_t, size_t)> progress = nullptr);
+
+    /*!
+      Sets the callback which receives stock changes of the parts shown in the details. The
+      stock is polled every "stock_poll_s" seconds or pushed over "stock_websocket_url[.N]", see
+      configureStockWatch(...). The callback is invoked from the poller or a websocket thread
+      @param[in] f receives the position of the part in the found parts (-1 if it is not listed
+                 anymore), the changed details, e.g. "In Stock", and the driver ID
+      */
+    void CallbackForStockUpdates(std::function<void(int, std::map<wxString, wxString>, int)> f);
+
+    /*!
+      Writes the parts of all connected servers to a SQLite database which KiCad can browse as a
+      database library, with their parameters, default location and image. An existing database
+      is updated in place, only new and changed parts are written
+      @param[in] path database file
+      @param[in] descriptionPath KiCad library description (.kicad_dbl) to write, empty writes
+                 none
+      @return number of parts written, -1 if the export failed or the driver was built without
+              SQLite
+      */
+    long exportDatabaseLibrary(const std::string &path,
+                               const std::string &descriptionPath = std::string());
+
+    /*!
+      Searches like searchWareHouseForParts(...), but only for parts in a category and its
+      subcategories. The category is given by its path, e.g. "Passives/Resistors", as listed by
+      Filters()["Category"], so it selects the same category on every server. Servers without the
+      category are not asked, an empty category searches everything
+      */
+    void searchWareHouseForPartsInCategory(std::string searchTerm, const wxString &category);
+
+    /*!
+      Finds parts by their exact IPN, manufacturer part number or supplier part number (SKU)
+      without asking the server, e.g. to check the lines of a BOM against stock. Case, spaces and
+      punctuation are ignored. Needs "part_number_index=on", the numbers of every server are
+      loaded in the background on connect, see configurePartNumbers(...)
+      @param[in] number part number as it appears in the BOM
+      @return server index and pk of every part carrying the number, empty if there is none or the
+              numbers are not loaded yet
+      */
+    std::vector<std::pair<int, int>> findPartsByNumber(const wxString &number);
+
 private:
+    enum Endpoint {
+        _API_VERSION = 0,
+        _AUTH_TOKEN,
+        _PART_SEARCH,
+        _PART_DETAIL,
+        _PART_PARAMETERS,
+        _PART_IMAGE,
+        _PARAMETER_TEMPLATES,
+        _STOCK_LOCATIONS,
+        _CREATE,
+        _CATALOG,
+        _STOCK,
+        _LIBRARY,
+        _PART_CATEGORIES,
+        _PART_NUMBERS,
+        _ENDPOINT_COUNT
+    };
+
+    /**
+     * An InvenTree server the driver is connected to, with its own token and reference data
+     */
+    struct SERVER_CONNECTION {
+        // shown in front of the search results if more than one server is connected
+        wxString m_tag;
+
+        // URL to warehouse API
+        std::string m_serverURL;
+        std::string m_apiURL;
+
+        std::string m_username;
+        std::string m_password;
+
+        // snapshot file of this server's catalog, empty if none is kept
+        std::string m_snapshotFile;
+
+        wxString m_apiToken;
+        std::map<wxString, wxString> m_apiVersion;
+
+        // parameter templates, stock locations and categories, shared with the other driver
+        // instances
+        std::shared_ptr<REFERENCE_DATA> m_reference;
+
+        // catalog of an earlier session, used for everything the live data above does not cover,
+        // only access it through std::atomic_load(...) and std::atomic_store(...)
+        std::shared_ptr<const CATALOG_SNAPSHOT> m_snapshot;
+
+        // set if the server could not be reached and the snapshot answers instead
+        bool m_offline = false;
+
+        // pushes stock changes instead of being polled, if it is set and connected
+        std::string m_stockWebsocketURL;
+        std::unique_ptr<web::websockets::client::websocket_callback_client> m_stockSocket;
+        std::atomic<bool> m_stockPushed{false};
+
+        // set once the server answered a stock poll with parts which were not asked for, the
+        // parts are then polled one by one
+        std::atomic<bool> m_stockFilterIgnored{false};
+
+        std::array<LATENCY_TRACKER, _ENDPOINT_COUNT> m_latencies;
+
+        // set for endpoints which reject the field projection
+        std::array<std::atomic<bool>, _ENDPOINT_COUNT> m_projectionRejected{};
+
+        // parameter template name (lower case) -> pk, including templates which are still
+        // being created, so each missing template is only created once
+        std::map<wxString, pplx::task<int>> m_templateIndex;
+        bool m_templateIndexBuilt = false;
+        std::mutex m_templateMutex;
+    };
+
+    typedef std::shared_ptr<SERVER_CONNECTION> SERVER_PTR;
+
+    /**
+     * Search results of all servers, merged in the order the servers answer
+     */
+    struct MERGED_SEARCH {
+        std::mutex m_mutex;
+        std::vector<FOUND_PART> m_parts;
+
+        // descriptions as listed, prefixed with the server tag if several servers are connected
+        std::vector<wxString> m_list;
+
+        // IPN of every listed part -> server it was found on
+        std::map<wxString, int> m_seen;
+        bool m_delivered = false;
+    };
 
     void CallbackForFoundParts(std::function<void(std::vector<wxString>, int)> f) override;
 
@@ -232,35 +470,435 @@ private:
 
     wxString driverVersion() override;
 
-    void getAuthToken(const std::string &username, const std::string &password);
+    /*!
+      Reads the servers to connect to from the connection arguments. "server_url",
+      "server_port", "username", "password" and "server_tag" describe the first server, further
+      servers are added with an index, e.g. "server_url.1", "server_port.1", "server_tag.1".
+      Missing credentials and ports of indexed servers are taken from the first server
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    std::vector<SERVER_PTR> configureServers(std::map<wxString, wxString> &args);
+
+    /*!
+      Queries the version, requests a token and loads the reference data of a server, or
+      attaches to the reference data another instance has loaded. With a snapshot file the
+      reference data is mapped from the file instead and refreshed in the background once it is
+      older than "snapshot_max_age_s"
+      @return bool returns true if a token was received or a snapshot can answer instead
+      */
+    bool connectServer(const SERVER_PTR &server);
+
+    /*!
+      Loads the parameter templates, stock locations and part categories of a server, unless
+      another driver instance has loaded them already. Instances connecting meanwhile wait for the
+      first one
+      @param[in] categoriesOnly only load the categories, e.g. if a snapshot provides the rest
+      @return bool returns true if the reference data is available
+      */
+    bool loadReferenceData(const SERVER_PTR &server, bool categoriesOnly = false);
+
+    // reference data of all servers the process is connected to, by server url and user
+    static SHARED_REGISTRY<REFERENCE_DATA> &referenceRegistry();
+
+    /*!
+      Maps the snapshot file of a server, a snapshot of another server is not used
+      @return nullptr if there is no usable snapshot
+      */
+    std::shared_ptr<const CATALOG_SNAPSHOT> openSnapshot(const SERVER_PTR &server);
+
+    /*!
+      Loads templates, stock locations and all parts from the server, writes them to the
+      server's snapshot file and maps the new file
+      @return bool returns true if the snapshot was replaced
+      */
+    bool writeSnapshot(const SERVER_PTR &server);
+
+    // runs writeSnapshot(...) on a pplx worker, tracked like a pending request
+    void refreshSnapshot(const SERVER_PTR &server);
+
+    /*!
+      Reads "snapshot_max_age_s" (age after which a snapshot is refreshed, default one day) from
+      the connection arguments. The files are set per server with "snapshot_file[.N]"
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureSnapshots(std::map<wxString, wxString> &args);
+
+    void getAuthToken(const SERVER_PTR &server);
+
+    /*!
+      Reads "library_file" (database library kept up to date on every connect),
+      "library_description_file" (.kicad_dbl written along with it) and "library_name" (default
+      InvenTree) from the connection arguments
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureLibrary(std::map<wxString, wxString> &args);
+
+    // runs writeLibrary(...) on a pplx worker, tracked like a pending request
+    void refreshLibrary();
+
+    /*!
+      Exports the parts of the given servers, see exportDatabaseLibrary(...). Offline servers are
+      skipped, their parts are left as they are
+      */
+    long writeLibrary(const std::vector<SERVER_PTR> &servers, const std::string &path,
+                      const std::string &descriptionPath);
+
+    /*!
+      Loads all parts and all part parameters of a server for the database library
+      @param[out] parameters names of the server's parameter templates
+      @param[out] rows one row per part
+      @return bool returns true if both lists were loaded
+      */
+    bool loadLibraryRows(const SERVER_PTR &server, std::vector<std::string> &parameters,
+                         std::vector<LIBRARY_ROW> &rows);
+
+    /*!
+      Reads "part_number_index" (on loads the part numbers of every server on connect, default
+      off) from the connection arguments
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configurePartNumbers(std::map<wxString, wxString> &args);
+
+    // runs loadPartNumbers(...) for every online server on a pplx worker, tracked like a pending
+    // request
+    void refreshPartNumbers();
+
+    /*!
+      Loads the IPNs of all parts and the part numbers of all manufacturer and supplier parts of
+      a server
+      @param[out] table part number -> pks
+      @return bool returns true if at least the parts were loaded
+      */
+    bool loadPartNumbers(const SERVER_PTR &server, PART_NUMBER_INDEX::TABLE &table);
+
+    /*!
+      Reads "stock_watch_size" (number of recently selected parts whose stock is watched, default
+      16, 0 disables the watch) and "stock_poll_s" (seconds between two polls, default 0 which
+      only watches servers with a "stock_websocket_url[.N]") from the connection arguments
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureStockWatch(std::map<wxString, wxString> &args);
+
+    // connects the stock websockets and starts the poller, with the connection lock held
+    void startStockWatch();
+
+    // stops the poller and closes the stock websockets, before the servers are replaced
+    void stopStockWatch();
+
+    void runStockPoller();
+
+    /*!
+      Asks a server for the stock of its watched parts with one conditional request
+      @return completes once the answer has been applied, never fails
+      */
+    pplx::task<void> pollStock(const SERVER_PTR &server, int serverIdx);
+
+    /*!
+      Opens the stock websocket of a server, polling takes over if it can not be opened or is
+      closed later. Messages are a part {"pk": 1, "in_stock": 5} or a list of parts
+      */
+    void connectStockSocket(const SERVER_PTR &server, int serverIdx);
+
+    /*!
+      Passes the stock of the parts in a poll response or websocket message on to
+      publishStockLevel(...)
+      @param[in] obj a part, a list of parts or a paginated list of parts
+      @param[in] requested pks which were asked for, empty if the parts were pushed
+      */
+    void applyStockLevels(const SERVER_PTR &server, int serverIdx, const json::value &obj,
+                          const std::vector<int> &requested);
+
+    /*!
+      Pushes the stock of a watched part through the stock callback if it changed, and drops the
+      cached result sets which contain the part
+      */
+    void publishStockLevel(int serverIdx, int pk, const wxString &inStock);
 
     void searchWareHouseForParts(std::string searchTerm) override;
 
+    /*!
+      Reads the parts of a search response, which is either a plain list or a paginated object
+      if a limit was requested
+      @param[in] obj search response
+      @param[in] server index of the server which sent the response
+      @param[out] complete false if the server found more parts than it returned
+      @param[in] categories categories of the server, if given the category names and part
+      numbers are added to the search text of the parts, see FOUND_PART::m_searchComplete
+      */
+    std::vector<FOUND_PART> parseFoundParts(const json::value &obj, int server, bool &complete,
+                                            const CATEGORY_INDEX *categories = nullptr);
+
+    /*!
+      Adds the parts found on one server to the merged results and passes the merged list to the
+      found parts callback. Parts with the same IPN as a part from another server are skipped,
+      parts without an IPN are always listed. Must be called with the merged results' mutex held
+      @param[in] parts parts found on one server
+      @param[in,out] merged results so far
+      */
+    void mergeFoundParts(const std::vector<FOUND_PART> &parts, MERGED_SEARCH &merged);
+
+    /*!
+      Removes the parts outside of a category subtree, e.g. from a cached result set. Parts whose
+      category is not known are kept
+      @param[in] category pk of the top category, all parts are kept if it is negative
+      */
+    static void scopeToCategory(std::vector<FOUND_PART> &parts, const CATEGORY_INDEX &categories,
+                                int category);
+
+    /*!
+      Sets up reuse of recent search results from the connection arguments "search_cache_size"
+      (number of result sets, 0 disables the cache), "search_cache_ttl_s" and "search_limit"
+      (maximum number of parts requested per search, 0 requests all)
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureSearchCache(std::map<wxString, wxString> &args);
+
     void getSelectedPartParameters(int listPos) override;
 
-    void getPartParameters(int jsonResponse);
+    /*!
+      Queries the parameters of a part
+      @param[in] pk primary key of the part
+      @return the part's parameters, empty if the request failed
+      */
+    std::vector<PART_PARAMETER> getPartParameters(const SERVER_PTR &server, int pk);
 
-    void getPartAttributes(int pk);
+    /*!
+      Queries the attributes of a part, only the visible attributes are kept
+      @param[in] pk primary key of the part
+      @return the part's attributes, empty if the request failed
+      */
+    std::vector<PART_ATTRIBUTE> getPartAttributes(const SERVER_PTR &server, int pk);
 
-    void getInvenTreeVersion();
+    void getInvenTreeVersion(const SERVER_PTR &server);
 
     bool addPartToWareHouse(std::map<wxString, wxString> parameters) override;
 
+    /*!
+      Creates a part and then all its parameters at once. Known keys (name, description, IPN,
+      keywords, link/datasheet, notes, units, revision, category) become fields of the part, all
+      other keys become parameters. "Manufacturer Part Number" is used as name if there is none
+      @param[in] server server to create the part on
+      @param[in] parameters part data, e.g. from a distributor driver
+      @return completes with true if the part and all its parameters were created, the caller
+      is not blocked while the requests are sent
+      */
+    pplx::task<bool> createPart(const SERVER_PTR &server,
+                                const std::map<wxString, wxString> &parameters);
+
+    /*!
+      Looks up the pk of a parameter template by name (case insensitive) and creates the
+      template if the server does not have it yet
+      @return the template's pk, fails with http_exception if it could not be created
+      */
+    pplx::task<int> resolveTemplate(const SERVER_PTR &server, const wxString &name);
+
+    /*!
+      Sends a POST request with a JSON body under the policy of the create endpoint. POST
+      requests are not retried
+      @return the created object, fails with http_exception if the server did not answer with
+              201 or 200
+      */
+    pplx::task<json::value> postJSONRequest(const SERVER_PTR &server, const std::string &url,
+                                            const json::value &body);
+
+    /*!
+      Sends a single GET request with If-None-Match under the policy of the endpoint, in the
+      background lane. The field projection is dropped for later requests if the server rejects it
+      @param[in] etag ETag of the previous response, empty for an unconditional request
+      @return the response, 304 if nothing changed since the ETag
+      */
+    pplx::task<http_response> conditionalGetRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                                    const std::string &url,
+                                                    const std::string &query,
+                                                    const std::string &etag);
+
+    // lower case, underscores replaced by spaces, e.g. "Default_Location" -> "default location"
+    static wxString normalizeKey(wxString key);
+
     std::map<wxString, std::vector<wxString>> Filters() override;
 
-    void getAllParameterTemplates();
+    /*!
+      Loads all parameter templates of a server
+      @param[in] publish replace the server's templates with the loaded ones
+      @return the loaded templates, nullptr if the request failed
+      */
+    std::shared_ptr<const std::vector<TEMPLATE_PARAMETER>> getAllParameterTemplates(
+            const SERVER_PTR &server, bool publish = true);
 
-    void getAllStockLocations();
+    // loads all stock locations of a server and adds up their stock items along the tree
+    std::shared_ptr<const STOCK_LOCATION_INDEX> getAllStockLocations(const SERVER_PTR &server,
+                                                                     bool publish = true);
+
+    // loads all part categories of a server and indexes them by their parent
+    std::shared_ptr<const CATEGORY_INDEX> getAllPartCategories(const SERVER_PTR &server,
+                                                               bool publish = true);
+
+    /*!
+      Loads the list of all parts of a server, with the fields of a search
+      @param[out] complete false if the request failed
+      */
+    std::vector<FOUND_PART> getAllParts(const SERVER_PTR &server, bool &complete);
 
     bool visibleAttributes(const wxString &term);
 
+    /*!
+      Reads a field of a JSON object as string
+      @return the field's value without quotation marks, or an empty string if it is missing or null
+      */
+    wxString stringField(const json::value &obj, const utility::string_t &name);
+
+    static std::vector<wxString> splitList(const wxString &list);
+
+    /*!
+      Selects the fields requested from each endpoint. The part detail fields follow
+      "visible_attributes" (comma separated), every endpoint can be overridden with
+      "fields_search", "fields_detail", "fields_parameters", "fields_templates",
+      "fields_locations" and "fields_categories". "field_projection=off" always requests
+      complete objects
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureFieldProjection(std::map<wxString, wxString> &args);
+
+    /*!
+      Appends the field projection of the endpoint to a query, unless it is disabled or the server
+      has rejected it before
+      */
+    std::string projectFields(const SERVER_PTR &server, Endpoint endpoint,
+                              const std::string &query) const;
+
     wxString formatNameString(wxString text);
 
+    /*!
+      Selects level and sink of the driver log from the connection arguments
+      "log_level" (trace, debug, info, warning, error, off), "log_sink" (off, file, status) and
+      "log_file". The status sink is kept per instance and called on the logging thread, the
+      other sinks are shared by all instances
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureLogger(std::map<wxString, wxString> &args);
+
+    /*!
+      Sets up recording or replaying of the API traffic from the connection arguments
+      "traffic_record" (capture file to write), "traffic_replay" (capture file to answer all
+      requests from) and "traffic_replay_scale" (factor for the recorded latencies, default 1)
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      @return bool returns false if a capture which should be replayed could not be loaded
+      */
+    bool configureTrafficCapture(std::map<wxString, wxString> &args);
+
+    /*!
+      Creates a http client for the given url. All requests to InvenTree must use this function,
+      so traffic capture is applied consistently
+      @param[in] url absolute url of the endpoint
+      @param[in] config client configuration, e.g. credentials
+      */
+    http_client makeClient(const std::string &url,
+                           const http_client_config &config = http_client_config());
+
+    /*!
+      Sends a GET request with getRequest(...) and decodes the JSON response. Concurrent requests
+      for the same url, query and field projection are coalesced, they all share the response of
+      the first one
+      @return the decoded response, null if the server did not answer with 200
+      */
+    pplx::task<json::value> getJSONRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                           const std::string &url, const std::string &query = "",
+                                           const web::credentials &cred = web::credentials());
+
+    /*!
+      Sends a GET request to InvenTree under the deadline and retry policy of the endpoint. The
+      endpoint's field projection is added and dropped again if the server rejects it. If
+      hedging is enabled, a duplicate request is sent once the first one takes longer than the
+      endpoint's 95th percentile and whichever answers first is used
+      @param[in] server server the request is sent to, provides token and latency statistics
+      @param[in] endpoint selects the request policy
+      @param[in] url absolute url of the endpoint
+      @param[in] query query string including the leading '?'
+      @param[in] cred basic auth credentials, only used to obtain the token
+      @return the response, fails with http_exception once the deadline is exceeded
+      */
+    pplx::task<http_response> getRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                         const std::string &url, const std::string &query = "",
+                                         const web::credentials &cred = web::credentials());
+
+    // deadline and hedging of getRequest(...), without the field projection
+    pplx::task<http_response> dispatchGetRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                                 const std::string &url,
+                                                 const std::string &query,
+                                                 const web::credentials &cred);
+
+    pplx::task<http_response> sendGetRequest(const SERVER_PTR &server, Endpoint endpoint,
+                                             const std::string &url,
+                                             const std::string &query,
+                                             const web::credentials &cred,
+                                             std::chrono::steady_clock::time_point deadline,
+                                             int attempt, int maxAttempts);
+
+    pplx::task<http_response> hedgeRequest(
+            pplx::task<http_response> primary, std::chrono::microseconds delay,
+            std::function<pplx::task<http_response>()> sendDuplicate);
+
+    static bool isRetryable(status_code code);
+
+    // keep track of requests which may outlive the call that started them
+    void beginRequest();
+
+    void endRequest();
+
+    /*!
+      Counts as a pending request until the last copy of the returned guard is gone, so a request
+      whose continuations throw is still ended
+      */
+    std::shared_ptr<void> pendingRequest();
+
+    void waitForPendingRequests();
+
+    /*!
+      Applies per endpoint deadlines and retries from the connection arguments
+      "<endpoint>_deadline_ms" and "<endpoint>_retries" (endpoint being version, token, search,
+      detail, parameters, image, templates, locations, create, catalog, stock, library,
+      categories or partnumbers),
+      "request_timeout_ms" for a single attempt, "hedge_requests" (true/false) for search,
+      detail and parameter requests and "compression" (off disables compressed transfers)
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureRequestPolicies(std::map<wxString, wxString> &args);
+
+    /*!
+      Reads "bulk_parallelism" (parts created at the same time) and "default_category" (pk of the
+      category of new parts which do not name one) from the connection arguments
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configurePartCreation(std::map<wxString, wxString> &args);
+
+    /*!
+      Reads "executor_threads" (threads running decoding and continuations, default 4) and
+      "host_concurrency" (requests running against one server at once, default 6) from the
+      connection arguments
+      @param[in] args connection arguments as passed to connectToWarehouse(...)
+      */
+    void configureExecutor(std::map<wxString, wxString> &args);
+
+    // bulk imports, snapshot, library and part number loading and stock polls run in the
+    // background lane, everything else is waited for
+    static REQUEST_EXECUTOR::Lane laneOf(Endpoint endpoint);
+
     // general methods to evaluate server responses
-    pplx::task<json::value> evaluateServerResponse(http_response response);
+    pplx::task<json::value> evaluateServerResponse(http_response response,
+                                                   REQUEST_EXECUTOR::Lane lane);
 
     json::value evaluateJSONResponse(pplx::task<json::value> jsonResponse);
 
+    /*!
+      Reads the raw body of a response, decompresses it according to its Content-Encoding and
+      parses the JSON on the executor lane. Transfer size and decoding time are added to the metrics
+      */
+    pplx::task<json::value> decodeJSONResponse(http_response response,
+                                               REQUEST_EXECUTOR::Lane lane);
+
+    static std::string decompressBody(const utility::string_t &encoding,
+                                      const std::vector<unsigned char> &body);
+
     /*!
       Removes the quotation marks which are used by the API to embed string type data
       @param[in] str
@@ -269,26 +907,90 @@ private:
       */
     wxString removeQuotationMarks(std::string str);
 
-    wxString m_apiToken;
-    std::vector<web::json::value> m_foundParts;
+    // held exclusively while the connection is (re)configured, shared by all other calls
+    std::shared_timed_mutex m_connectionMutex;
+
+    // connected servers, only changed by connectToWarehouse(...)
+    std::vector<SERVER_PTR> m_servers;
+
+    // parts of the most recent search, replaced as a whole, only access it through
+    // std::atomic_load(...) and std::atomic_store(...)
+    std::shared_ptr<const std::vector<FOUND_PART>> m_foundParts =
+            std::make_shared<const std::vector<FOUND_PART>>();
 
-    std::vector<TEMPLATE_PARAMETER> m_parameterTemplates;
-    std::vector<STOCK_LOCATION> m_stockLocations;
-    std::vector<PART_PARAMETER> m_partParameters;
-    std::vector<PART_ATTRIBUTE> m_partAttributes;
-    std::map<wxString, wxString> APIVersion;
+    // complete result sets of recent searches, refined searches are answered from them
+    SEARCH_CACHE m_searchCache;
+    int m_searchLimit = 0;
 
-    // URL to warehouse API
-    std::string m_ServerURL;
-    std::string m_ApiURL;
+    // parts created at the same time by addPartsToWareHouse(...), and the category of new parts
+    // which do not name one
+    int m_bulkParallelism = 4;
+    int m_defaultCategory = -1;
+
+    std::chrono::seconds m_snapshotMaxAge = std::chrono::hours(24);
+
+    // database library refreshed on connect, empty if none is kept
+    std::string m_libraryFile;
+    std::string m_libraryDescriptionFile;
+    std::string m_libraryName = "InvenTree";
+
+    // exact part numbers of all servers, empty unless part_number_index is on
+    PART_NUMBER_INDEX m_partNumbers;
+    bool m_partNumberIndex = false;
+
+    // parts shown in the details whose stock is polled or pushed
+    STOCK_WATCH m_stockWatch;
+    std::chrono::seconds m_stockPollInterval{0};
+    std::thread m_stockPoller;
+    bool m_stockPollStop = false;
+    std::mutex m_stockPollMutex;
+    std::condition_variable m_stockPollWake;
 
     int m_driverID = -1;
 
+    enum TrafficMode {
+        _TRAFFIC_LIVE,
+        _TRAFFIC_RECORD,
+        _TRAFFIC_REPLAY
+    };
+
+    TrafficMode m_trafficMode = _TRAFFIC_LIVE;
+    std::shared_ptr<TRAFFIC_FILE> m_traffic;
+    double m_trafficLatencyScale = 1.0;
+
+    std::array<REQUEST_POLICY, _ENDPOINT_COUNT> m_requestPolicies;
+    utility::string_t m_acceptEncoding;
+
+    // attributes shown in the part details, also requested from the server
+    std::vector<wxString> m_visibleAttributes = {
+            "category", "description", "default_location", "full_name", "in_stock", "link",
+            "notes", "pk"
+    };
+
+    std::array<std::string, _ENDPOINT_COUNT> m_projectedFields;
+    bool m_fieldProjection = true;
+
+    DRIVER_METRICS m_metrics;
+
+    // runs requests and decoding, declared after the metrics it reports to
+    REQUEST_EXECUTOR m_executor{m_metrics};
+
+    // decoded responses of GET requests in flight, by url and query
+    std::map<std::string, pplx::task<json::value>> m_inFlight;
+    std::mutex m_inFlightMutex;
+
+    int m_pendingRequests = 0;
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingDone;
+
     std::function<void(std::vector<wxString>, int)> fCallbackDisplayFoundParts;
     std::function<void(std::map<wxString, wxString>, int)> fCallbackDisplayPartParameters;
     std::function<void(const wxString &, const wxString &,
                        IWareHouse::Display)> fCallbackDisplayStatusMessage;
+    std::function<void(int, std::map<wxString, wxString>, int)> fCallbackStockUpdates;
 
+    // log_sink=status, passes this instance's messages to fCallbackDisplayStatusMessage
+    INVENTREE_STATUS_LOG m_statusLog;
 };
 
 
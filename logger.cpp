@@ -0,0 +1,265 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "logger.h"
+
+#include <ctime>
+
+INVENTREE_LOGGER &INVENTREE_LOGGER::instance() {
+    // a few seconds of chatter during a bulk operation fit easily into the buffer
+    static INVENTREE_LOGGER logger(1024);
+    return logger;
+}
+
+INVENTREE_LOGGER::INVENTREE_LOGGER(size_t capacity) : m_buffer(capacity) {
+}
+
+INVENTREE_LOGGER::~INVENTREE_LOGGER() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_file)
+        fclose(m_file);
+}
+
+void INVENTREE_LOGGER::log(Level level, std::string message) {
+    if (!isEnabled(level))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_count == m_buffer.size()) {
+            // never block the caller, the drain thread is behind
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        ENTRY &entry = m_buffer[(m_head + m_count) % m_buffer.size()];
+        entry.m_level = level;
+        entry.m_time = std::chrono::system_clock::now();
+        entry.m_message = std::move(message);
+        m_count++;
+    }
+
+    m_wakeUp.notify_one();
+}
+
+void INVENTREE_LOGGER::setLevel(Level level) {
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    m_level = level;
+    updateThreshold();
+}
+
+bool INVENTREE_LOGGER::setSink(Sink sink, const std::string &filePath) {
+    bool success = true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+
+        if (m_file) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+
+        if (sink == _SINK_FILE) {
+            m_file = fopen(filePath.c_str(), "a");
+            success = m_file != nullptr;
+        }
+
+        m_sink = sink;
+        updateThreshold();
+    }
+
+    if (sink == _SINK_FILE)
+        startThread();
+
+    return success;
+}
+
+void INVENTREE_LOGGER::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_thread.joinable())
+        return;
+
+    m_drained.wait(lock, [this] { return (m_count == 0 && m_inFlight == 0) || m_stop; });
+}
+
+void INVENTREE_LOGGER::updateThreshold() {
+    bool active = m_sink == _SINK_FILE && m_file != nullptr;
+
+    m_threshold.store(active ? m_level : _OFF, std::memory_order_relaxed);
+}
+
+void INVENTREE_LOGGER::startThread() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_thread.joinable() && !m_stop)
+        m_thread = std::thread(&INVENTREE_LOGGER::drain, this);
+}
+
+void INVENTREE_LOGGER::drain() {
+    std::vector<ENTRY> batch;
+    batch.reserve(m_buffer.size());
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this] { return m_stop || m_count > 0; });
+
+            if (m_stop && m_count == 0)
+                break;
+
+            // take everything queued so far and release the lock before doing any I/O
+            for (; m_count > 0; m_count--) {
+                batch.emplace_back(std::move(m_buffer[m_head]));
+                m_head = (m_head + 1) % m_buffer.size();
+            }
+            m_inFlight = batch.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_sinkMutex);
+
+            for (const auto &entry : batch)
+                write(entry);
+
+            if (m_file)
+                fflush(m_file);
+        }
+
+        batch.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight = 0;
+        }
+        m_drained.notify_all();
+    }
+
+    m_drained.notify_all();
+}
+
+void INVENTREE_LOGGER::write(const ENTRY &entry) {
+    // the level may have been raised after the message was queued
+    if (entry.m_level < m_level)
+        return;
+
+    if (m_sink == _SINK_FILE && m_file) {
+        std::time_t time = std::chrono::system_clock::to_time_t(entry.m_time);
+        long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                entry.m_time.time_since_epoch()).count() % 1000;
+
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", std::localtime(&time));
+
+        fprintf(m_file, "%s.%03ld [%s] %s\n", timestamp, ms, levelName(entry.m_level),
+                entry.m_message.c_str());
+    }
+}
+
+const char *INVENTREE_LOGGER::levelName(Level level) {
+    switch (level) {
+        case _TRACE:
+            return "TRACE";
+        case _DEBUG:
+            return "DEBUG";
+        case _INFO:
+            return "INFO";
+        case _WARNING:
+            return "WARNING";
+        case _ERROR:
+            return "ERROR";
+        default:
+            return "OFF";
+    }
+}
+
+INVENTREE_LOGGER::Level INVENTREE_LOGGER::levelFromString(const wxString &level) {
+    wxString l = level.Lower();
+
+    if (l == "trace")
+        return _TRACE;
+    if (l == "debug")
+        return _DEBUG;
+    if (l == "info")
+        return _INFO;
+    if (l == "warning" || l == "warn")
+        return _WARNING;
+    if (l == "error")
+        return _ERROR;
+
+    return _OFF;
+}
+
+void INVENTREE_STATUS_LOG::log(INVENTREE_LOGGER::Level level, const std::string &message) {
+    STATUS_CALLBACK callback;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // the level may have been raised since isEnabled(...)
+        if (level < m_level || !m_callback)
+            return;
+
+        callback = m_callback;
+    }
+
+    // the callback may log again
+    try {
+        callback(wxString(message), wxString("InvenTree ") + INVENTREE_LOGGER::levelName(level));
+    }
+    catch (...) {
+        // a failing callback must not take the logging request down
+    }
+}
+
+void INVENTREE_STATUS_LOG::setLevel(INVENTREE_LOGGER::Level level) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_level = level;
+    updateThreshold();
+}
+
+void INVENTREE_STATUS_LOG::setCallback(STATUS_CALLBACK callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = std::move(callback);
+    updateThreshold();
+}
+
+void INVENTREE_STATUS_LOG::updateThreshold() {
+    m_threshold.store(m_callback ? m_level : INVENTREE_LOGGER::_OFF, std::memory_order_relaxed);
+}
+
+bool INVENTREE_STATUS_LOG::isStatusSink(const wxString &sink) {
+    wxString s = sink.Lower();
+    return s == "status" || s == "callback";
+}
+
+INVENTREE_LOGGER::Sink INVENTREE_LOGGER::sinkFromString(const wxString &sink) {
+    wxString s = sink.Lower();
+
+    if (s == "file")
+        return _SINK_FILE;
+
+    return _SINK_OFF;
+}
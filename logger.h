@@ -0,0 +1,207 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_LOGGER_H
+#define INVENTREE_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+ * Logs a message through the process wide logger. The stream expression is only evaluated if the
+ * level is enabled, so a disabled logger costs a single relaxed atomic load.
+ *
+ * Usage: INVENTREE_LOG(INVENTREE_LOGGER::_INFO, count << " location(s) received");
+ */
+#define INVENTREE_LOG(level, expr)                                                      \
+    do {                                                                                \
+        if (INVENTREE_LOGGER::instance().isEnabled(level)) {                            \
+            std::ostringstream inventreeLogStream_;                                     \
+            inventreeLogStream_ << expr;                                                \
+            INVENTREE_LOGGER::instance().log(level, inventreeLogStream_.str());         \
+        }                                                                               \
+    } while (0)
+
+/*!
+ * Like INVENTREE_LOG, and passes the message to an INVENTREE_STATUS_LOG as well, e.g. the status
+ * callback of the driver instance which logs it.
+ *
+ * Usage: INVENTREE_LOG_STATUS(m_statusLog, INVENTREE_LOGGER::_ERROR, "Connection failed");
+ */
+#define INVENTREE_LOG_STATUS(status, level, expr)                                       \
+    do {                                                                                \
+        bool inventreeToLogger_ = INVENTREE_LOGGER::instance().isEnabled(level);        \
+        bool inventreeToStatus_ = (status).isEnabled(level);                            \
+        if (inventreeToLogger_ || inventreeToStatus_) {                                 \
+            std::ostringstream inventreeLogStream_;                                     \
+            inventreeLogStream_ << expr;                                                \
+            if (inventreeToStatus_)                                                     \
+                (status).log(level, inventreeLogStream_.str());                         \
+            if (inventreeToLogger_)                                                     \
+                INVENTREE_LOGGER::instance().log(level, inventreeLogStream_.str());     \
+        }                                                                               \
+    } while (0)
+
+
+/**
+ * A leveled logger which keeps the driver's hot paths free of I/O.
+ * Messages are copied into a bounded ring buffer and written by a background thread to the
+ * selected sink. If the buffer is full, new messages are dropped and counted instead of blocking
+ * the caller (usually a pplx worker thread).
+ * The status callback of a driver is not a sink of the process wide logger, see
+ * INVENTREE_STATUS_LOG.
+ */
+class INVENTREE_LOGGER {
+public:
+    enum Level {
+        _TRACE = 0,
+        _DEBUG,
+        _INFO,
+        _WARNING,
+        _ERROR,
+        _OFF
+    };
+
+    enum Sink {
+        _SINK_OFF = 0,
+        _SINK_FILE
+    };
+
+    /*!
+      Returns the process wide logger instance. The drain thread is only started once a sink is
+      selected
+      */
+    static INVENTREE_LOGGER &instance();
+
+    ~INVENTREE_LOGGER();
+
+    bool isEnabled(Level level) const {
+        return level >= m_threshold.load(std::memory_order_relaxed);
+    }
+
+    /*!
+      Copies the message into the ring buffer. Never blocks on I/O
+      @param[in] level severity of the message
+      @param[in] message text to log
+      */
+    void log(Level level, std::string message);
+
+    void setLevel(Level level);
+
+    /*!
+      Selects the output of the logger. Switching to _SINK_OFF disables logging entirely
+      @param[in] sink new sink
+      @param[in] filePath log file, only used by _SINK_FILE
+      @return bool returns false if the log file could not be opened
+      */
+    bool setSink(Sink sink, const std::string &filePath = "");
+
+    /*!
+      Blocks until all messages queued so far have been written
+      */
+    void flush();
+
+    size_t droppedMessages() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    static Level levelFromString(const wxString &level);
+
+    static Sink sinkFromString(const wxString &sink);
+
+    static const char *levelName(Level level);
+
+private:
+    struct ENTRY {
+        Level m_level = _INFO;
+        std::chrono::system_clock::time_point m_time;
+        std::string m_message;
+    };
+
+    explicit INVENTREE_LOGGER(size_t capacity);
+
+    void updateThreshold();
+
+    void startThread();
+
+    void drain();
+
+    void write(const ENTRY &entry);
+
+    // ring buffer, guarded by m_mutex
+    std::vector<ENTRY> m_buffer;
+    size_t m_head = 0;
+    size_t m_count = 0;
+    size_t m_inFlight = 0;
+
+    std::atomic<int> m_threshold{_OFF};
+    std::atomic<size_t> m_dropped{0};
+
+    Level m_level = _INFO;
+    Sink m_sink = _SINK_OFF;
+    FILE *m_file = nullptr;
+
+    bool m_stop = false;
+    std::mutex m_mutex;
+    // guards the sink configuration, which is used by the drain thread while writing
+    std::mutex m_sinkMutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_drained;
+    std::thread m_thread;
+};
+
+
+/**
+ * Passes the log messages of one driver instance to its status callback. Unlike the sinks of
+ * INVENTREE_LOGGER the callback is called right away, on the thread which logs the message: it
+ * is KiCad's GUI code, and belongs to the instance which produced the message.
+ * All methods are thread safe.
+ */
+class INVENTREE_STATUS_LOG {
+public:
+    typedef std::function<void(const wxString &, const wxString &)> STATUS_CALLBACK;
+
+    bool isEnabled(INVENTREE_LOGGER::Level level) const {
+        return level >= m_threshold.load(std::memory_order_relaxed);
+    }
+
+    void log(INVENTREE_LOGGER::Level level, const std::string &message);
+
+    // messages below the level are not passed on, _OFF (the default) passes none
+    void setLevel(INVENTREE_LOGGER::Level level);
+
+    void setCallback(STATUS_CALLBACK callback);
+
+    // @return true if the "log_sink" connection argument selects the status callback
+    static bool isStatusSink(const wxString &sink);
+
+private:
+    void updateThreshold();
+
+    std::atomic<int> m_threshold{INVENTREE_LOGGER::_OFF};
+    INVENTREE_LOGGER::Level m_level = INVENTREE_LOGGER::_OFF;
+    STATUS_CALLBACK m_callback;
+    std::mutex m_mutex;
+};
+
+#endif //INVENTREE_LOGGER_H
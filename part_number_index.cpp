@@ -0,0 +1,152 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "part_number_index.h"
+
+#include <algorithm>
+#include <cctype>
+
+std::string PART_NUMBER_INDEX::normalize(const std::string &number) {
+    std::string key;
+    key.reserve(number.size());
+
+    for (char c : number) {
+        unsigned char byte = static_cast<unsigned char>(c);
+
+        // bytes of UTF-8 sequences are kept, ASCII punctuation and spaces are dropped
+        if (byte >= 0x80)
+            key += c;
+        else if (std::isalnum(byte))
+            key += static_cast<char>(std::tolower(byte));
+    }
+
+    return key;
+}
+
+void PART_NUMBER_INDEX::add(TABLE &table, const std::string &number, int pk) {
+    std::string key = normalize(number);
+    if (key.empty())
+        return;
+
+    // a part may carry the same number as IPN, MPN and SKU
+    std::vector<int> &pks = table.m_keys[key];
+    if (std::find(pks.begin(), pks.end(), pk) != pks.end())
+        return;
+
+    pks.push_back(pk);
+
+    std::string lower = number;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    std::string &numbers = table.m_numbers[pk];
+    numbers += numbers.empty() ? lower : " " + lower;
+}
+
+void PART_NUMBER_INDEX::beginLoad(int server) {
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    m_addedDuringLoad[server].clear();
+}
+
+void PART_NUMBER_INDEX::replace(int server, TABLE table) {
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+
+    auto added = m_addedDuringLoad.find(server);
+    if (added != m_addedDuringLoad.end()) {
+        for (const auto &number : added->second)
+            add(table, number.first, number.second);
+
+        m_addedDuringLoad.erase(added);
+    }
+
+    m_tables[server] = std::move(table);
+}
+
+void PART_NUMBER_INDEX::cancelLoad(int server) {
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    m_addedDuringLoad.erase(server);
+}
+
+void PART_NUMBER_INDEX::add(int server, const std::string &number, int pk) {
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+
+    // a table which is only made of added numbers would look loaded
+    auto table = m_tables.find(server);
+    if (table != m_tables.end())
+        add(table->second, number, pk);
+
+    auto added = m_addedDuringLoad.find(server);
+    if (added != m_addedDuringLoad.end())
+        added->second.emplace_back(number, pk);
+}
+
+std::vector<std::pair<int, int>> PART_NUMBER_INDEX::lookup(const std::string &number) const {
+    std::vector<std::pair<int, int>> parts;
+    std::string key = normalize(number);
+
+    if (key.empty())
+        return parts;
+
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+    for (const auto &table : m_tables) {
+        auto entry = table.second.m_keys.find(key);
+        if (entry == table.second.m_keys.end())
+            continue;
+
+        for (int pk : entry->second)
+            parts.emplace_back(table.first, pk);
+    }
+
+    return parts;
+}
+
+bool PART_NUMBER_INDEX::numbers(int server, int pk, std::string &numbers) const {
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+    numbers.clear();
+
+    auto table = m_tables.find(server);
+    if (table == m_tables.end())
+        return false;
+
+    auto part = table->second.m_numbers.find(pk);
+    if (part != table->second.m_numbers.end())
+        numbers = part->second;
+
+    return true;
+}
+
+bool PART_NUMBER_INDEX::loaded(int server) const {
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+    return m_tables.count(server) > 0;
+}
+
+size_t PART_NUMBER_INDEX::size() const {
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+    size_t keys = 0;
+    for (const auto &table : m_tables)
+        keys += table.second.m_keys.size();
+
+    return keys;
+}
+
+void PART_NUMBER_INDEX::clear() {
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    m_tables.clear();
+    m_addedDuringLoad.clear();
+}
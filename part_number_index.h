@@ -0,0 +1,100 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_PART_NUMBER_INDEX_H
+#define INVENTREE_PART_NUMBER_INDEX_H
+
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*! Finds parts by an exact part number (IPN, manufacturer or supplier part number) without asking
+ * the server, e.g. to match the lines of a BOM against stock.
+ *
+ * Numbers are compared normalized: letters are folded to lower case and everything which is
+ * neither a letter nor a digit is dropped, so "RC0603FR-0710KL", "rc0603fr 0710kl" and
+ * "RC0603FR.0710KL" are the same key. Non-ASCII characters are kept as they are.
+ * Every server has a table of its own, which is replaced as a whole when the server's numbers
+ * have been loaded again. The table also keeps the numbers of every part as they are, so a search
+ * cache can match them like the server does. Numbers added while a load is running are kept over
+ * the replacement, the loaded table may have been read from the server before they existed.
+ * All methods are thread safe.
+ * */
+class PART_NUMBER_INDEX {
+public:
+    struct TABLE {
+        // normalized part number -> pks of the parts carrying it
+        std::unordered_map<std::string, std::vector<int>> m_keys;
+
+        // pk -> lower case numbers of the part, separated by spaces
+        std::unordered_map<int, std::string> m_numbers;
+
+        // number of keys
+        size_t size() const { return m_keys.size(); }
+    };
+
+    // @return the key of a part number, empty if it has no letter or digit
+    static std::string normalize(const std::string &number);
+
+    // adds a part number to a table which is being built, numbers without a key are skipped
+    static void add(TABLE &table, const std::string &number, int pk);
+
+    // the numbers added from now on are kept over the next replace(...) of the server
+    void beginLoad(int server);
+
+    // replaces the table of a server, numbers added since beginLoad(...) are added to it
+    void replace(int server, TABLE table);
+
+    // the load failed, the server keeps its table
+    void cancelLoad(int server);
+
+    // adds a part number of a single part, e.g. of a part which was just created. Until the
+    // server's table has been loaded the number is only kept for the running load
+    void add(int server, const std::string &number, int pk);
+
+    /*!
+      Looks up a part number in the tables of all servers
+      @return server index and pk of every part carrying the number
+      */
+    std::vector<std::pair<int, int>> lookup(const std::string &number) const;
+
+    /*!
+      Gets the lower case part numbers of a part, e.g. "rc0603fr-0710kl 311-10.0khrct-nd"
+      @param[out] numbers numbers of the part, empty if it has none
+      @return false if the server's table has not been loaded
+      */
+    bool numbers(int server, int pk, std::string &numbers) const;
+
+    // @return true once a table has been set for the server
+    bool loaded(int server) const;
+
+    // number of keys of all servers
+    size_t size() const;
+
+    void clear();
+
+private:
+    std::map<int, TABLE> m_tables;
+
+    // numbers and pks added while the server's table is loaded
+    std::map<int, std::vector<std::pair<std::string, int>>> m_addedDuringLoad;
+    mutable std::shared_timed_mutex m_mutex;
+};
+
+#endif //INVENTREE_PART_NUMBER_INDEX_H
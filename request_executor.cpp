@@ -0,0 +1,271 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "request_executor.h"
+
+#include <algorithm>
+
+namespace {
+/**
+ * Hands the continuations pplx schedules to one lane of an executor
+ */
+class LANE_SCHEDULER : public pplx::scheduler_interface {
+public:
+    LANE_SCHEDULER(REQUEST_EXECUTOR &executor, REQUEST_EXECUTOR::Lane lane)
+            : m_executor(executor), m_lane(lane) {}
+
+    void schedule(pplx::TaskProc_t proc, void *param) override {
+        m_executor.post(m_lane, [proc, param]() { proc(param); });
+    }
+
+private:
+    REQUEST_EXECUTOR &m_executor;
+    REQUEST_EXECUTOR::Lane m_lane;
+};
+
+// every n-th job is taken from the background lane, if it has work waiting
+const size_t BACKGROUND_SHARE = 8;
+}
+
+REQUEST_EXECUTOR::REQUEST_EXECUTOR(DRIVER_METRICS &metrics, size_t threads, size_t hostLimit)
+        : m_metrics(metrics), m_hostLimit(std::max<size_t>(hostLimit, 1)) {
+    for (int lane = 0; lane < _LANE_COUNT; lane++)
+        m_schedulers[lane] = std::make_shared<LANE_SCHEDULER>(*this, static_cast<Lane>(lane));
+
+    startWorkers(threads);
+
+    m_timerThread = std::thread([this]() { runTimers(); });
+}
+
+REQUEST_EXECUTOR::~REQUEST_EXECUTOR() {
+    // the continuations of the last delays may still post work
+    stopTimers();
+    stopWorkers();
+}
+
+void REQUEST_EXECUTOR::configure(size_t threads, size_t hostLimit) {
+    {
+        std::lock_guard<std::mutex> lock(m_hostMutex);
+        m_hostLimit = std::max<size_t>(hostLimit, 1);
+    }
+
+    threads = std::max<size_t>(threads, 1);
+
+    if (threads == m_workers.size())
+        return;
+
+    stopWorkers();
+    startWorkers(threads);
+}
+
+void REQUEST_EXECUTOR::startWorkers(size_t threads) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stopping = false;
+
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+        m_workers.emplace_back([this]() { run(); });
+}
+
+void REQUEST_EXECUTOR::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    // the workers leave once both lanes are empty
+    for (auto &worker : m_workers)
+        worker.join();
+
+    m_workers.clear();
+}
+
+void REQUEST_EXECUTOR::post(Lane lane, std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_stopping) {
+            m_jobs[lane].push_back(JOB{std::move(work), std::chrono::steady_clock::now()});
+            queued(lane);
+            m_wake.notify_one();
+            return;
+        }
+    }
+
+    // the workers may already have left, late continuations run right away
+    work();
+}
+
+void REQUEST_EXECUTOR::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_wake.wait(lock, [this]() {
+            return m_stopping || !m_jobs[_INTERACTIVE].empty() || !m_jobs[_BACKGROUND].empty();
+        });
+
+        bool background = m_jobs[_INTERACTIVE].empty() ||
+                          (!m_jobs[_BACKGROUND].empty() &&
+                           ++m_dispatchCount % BACKGROUND_SHARE == 0);
+        Lane lane = background ? _BACKGROUND : _INTERACTIVE;
+
+        if (m_jobs[lane].empty())
+            return; // stopping and nothing left to do
+
+        JOB job = std::move(m_jobs[lane].front());
+        m_jobs[lane].pop_front();
+
+        lock.unlock();
+
+        dispatched(lane, job.m_queued, true);
+        job.m_work();
+
+        lock.lock();
+    }
+}
+
+pplx::task<void> REQUEST_EXECUTOR::acquire(const std::string &host, Lane lane) {
+    std::lock_guard<std::mutex> lock(m_hostMutex);
+
+    HOST &state = m_hosts[host];
+    auto now = std::chrono::steady_clock::now();
+
+    // requests of a lane never overtake each other
+    if (state.m_waiting[lane].empty() && state.m_active < hostLimit(lane)) {
+        state.m_active++;
+        dispatched(lane, now, false);
+        return pplx::task_from_result();
+    }
+
+    WAITER waiter;
+    waiter.m_queued = now;
+    state.m_waiting[lane].push_back(waiter);
+    queued(lane);
+
+    return pplx::create_task(waiter.m_granted);
+}
+
+void REQUEST_EXECUTOR::release(const std::string &host) {
+    std::vector<WAITER> granted;
+
+    {
+        std::lock_guard<std::mutex> lock(m_hostMutex);
+
+        HOST &state = m_hosts[host];
+        state.m_active--;
+
+        for (int lane = 0; lane < _LANE_COUNT; lane++) {
+            std::deque<WAITER> &waiting = state.m_waiting[lane];
+
+            while (!waiting.empty() && state.m_active < hostLimit(static_cast<Lane>(lane))) {
+                state.m_active++;
+                dispatched(static_cast<Lane>(lane), waiting.front().m_queued, true);
+                granted.push_back(waiting.front());
+                waiting.pop_front();
+            }
+        }
+    }
+
+    // continuations of the granted requests must not run under the lock
+    for (auto &waiter : granted)
+        waiter.m_granted.set();
+}
+
+pplx::task<void> REQUEST_EXECUTOR::delay(std::chrono::steady_clock::duration delay) {
+    TIMER timer;
+    timer.m_due = std::chrono::steady_clock::now() + delay;
+
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+
+        if (!m_timersStopping) {
+            m_timers.push(timer);
+            m_timerWake.notify_one();
+            return pplx::create_task(timer.m_expired);
+        }
+    }
+
+    return pplx::task_from_result();
+}
+
+void REQUEST_EXECUTOR::runTimers() {
+    std::unique_lock<std::mutex> lock(m_timerMutex);
+
+    while (true) {
+        if (m_timersStopping && m_timers.empty())
+            return;
+
+        if (m_timers.empty()) {
+            m_timerWake.wait(lock);
+            continue;
+        }
+
+        // stopping completes the remaining delays right away
+        if (!m_timersStopping && std::chrono::steady_clock::now() < m_timers.top().m_due) {
+            m_timerWake.wait_until(lock, m_timers.top().m_due);
+            continue;
+        }
+
+        TIMER timer = m_timers.top();
+        m_timers.pop();
+
+        // continuations must not run under the lock
+        lock.unlock();
+        timer.m_expired.set();
+        lock.lock();
+    }
+}
+
+void REQUEST_EXECUTOR::stopTimers() {
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        m_timersStopping = true;
+    }
+
+    m_timerWake.notify_all();
+    m_timerThread.join();
+}
+
+size_t REQUEST_EXECUTOR::hostLimit(Lane lane) const {
+    // background requests leave a slot to interactive ones
+    if (lane == _BACKGROUND && m_hostLimit > 1)
+        return m_hostLimit - 1;
+
+    return m_hostLimit;
+}
+
+void REQUEST_EXECUTOR::queued(Lane lane) {
+    long long depth = ++m_metrics.m_laneQueued[lane];
+    long long peak = m_metrics.m_lanePeakQueued[lane].load();
+
+    while (depth > peak && !m_metrics.m_lanePeakQueued[lane].compare_exchange_weak(peak, depth)) {
+        // peak was reloaded, try again
+    }
+}
+
+void REQUEST_EXECUTOR::dispatched(Lane lane, std::chrono::steady_clock::time_point queuedAt,
+                                   bool wasQueued) {
+    auto waited = std::chrono::steady_clock::now() - queuedAt;
+
+    if (wasQueued)
+        m_metrics.m_laneQueued[lane]--;
+
+    m_metrics.m_laneDispatched[lane]++;
+    m_metrics.m_laneWaitMicros[lane] +=
+            std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+}
@@ -0,0 +1,162 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_REQUEST_EXECUTOR_H
+#define INVENTREE_REQUEST_EXECUTOR_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pplx/pplxtasks.h>
+
+#include "driver_metrics.h"
+
+/*! Runs the network and decoding work of one driver in two priority lanes, so a background job
+ * like a bulk import or a snapshot refresh never holds back the search the user is waiting for.
+ *
+ * Work posted to the executor, directly or as pplx continuations through scheduler(...), runs on
+ * the executor's threads, interactive work first. Every eighth job is taken from the background
+ * lane if it has work waiting, so background jobs still make progress under constant
+ * interactive load.
+ *
+ * Requests are admitted per host with acquire(...) and release(...). At most "hostLimit" requests
+ * run against a host at once, background requests leave one of them to interactive requests.
+ *
+ * delay(...) completes a task once a time has passed, without occupying a thread while it waits.
+ *
+ * Work must not block on other work of the executor, e.g. wait for a request, as it may occupy
+ * the thread the awaited work needs.
+ * All methods are thread safe.
+ * */
+class REQUEST_EXECUTOR {
+public:
+    enum Lane {
+        _INTERACTIVE = 0,
+        _BACKGROUND,
+        _LANE_COUNT
+    };
+
+    /*!
+      @param[in] metrics receives queue depth and waiting time of both lanes
+      @param[in] threads number of worker threads
+      @param[in] hostLimit number of requests running against one host at once
+      */
+    explicit REQUEST_EXECUTOR(DRIVER_METRICS &metrics, size_t threads = 4, size_t hostLimit = 6);
+
+    ~REQUEST_EXECUTOR();
+
+    /*!
+      Changes the number of worker threads and the per host limit. Queued work is finished by the
+      old threads first, so no work of the executor must be running when it is reconfigured
+      */
+    void configure(size_t threads, size_t hostLimit);
+
+    void post(Lane lane, std::function<void()> work);
+
+    // pplx scheduler which posts the continuations it runs to a lane
+    pplx::scheduler_ptr scheduler(Lane lane) const { return m_schedulers[lane]; }
+
+    /*!
+      Waits for a free request slot of a host
+      @return completes once the request may be sent, release(...) must be called when it is done
+      */
+    pplx::task<void> acquire(const std::string &host, Lane lane);
+
+    void release(const std::string &host);
+
+    /*!
+      Waits without blocking a thread, e.g. between two attempts of a request. Delays still
+      running when the executor is destroyed complete right away
+      @return completes once the delay has passed
+      */
+    pplx::task<void> delay(std::chrono::steady_clock::duration delay);
+
+private:
+    struct JOB {
+        std::function<void()> m_work;
+        std::chrono::steady_clock::time_point m_queued;
+    };
+
+    struct WAITER {
+        pplx::task_completion_event<void> m_granted;
+        std::chrono::steady_clock::time_point m_queued;
+    };
+
+    struct HOST {
+        size_t m_active = 0;
+        std::array<std::deque<WAITER>, _LANE_COUNT> m_waiting;
+    };
+
+    struct TIMER {
+        std::chrono::steady_clock::time_point m_due;
+        pplx::task_completion_event<void> m_expired;
+
+        // the timer due first is on top of the queue
+        bool operator<(const TIMER &other) const { return m_due > other.m_due; }
+    };
+
+    void startWorkers(size_t threads);
+
+    void stopWorkers();
+
+    void run();
+
+    // completes the delays once they are due
+    void runTimers();
+
+    void stopTimers();
+
+    // requests of the lane which may run against one host at once
+    size_t hostLimit(Lane lane) const;
+
+    // queue depth metrics
+    void queued(Lane lane);
+
+    void dispatched(Lane lane, std::chrono::steady_clock::time_point queuedAt, bool wasQueued);
+
+    DRIVER_METRICS &m_metrics;
+
+    std::array<std::deque<JOB>, _LANE_COUNT> m_jobs;
+    std::vector<std::thread> m_workers;
+    size_t m_dispatchCount = 0;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+
+    std::map<std::string, HOST> m_hosts;
+    size_t m_hostLimit;
+    std::mutex m_hostMutex;
+
+    std::priority_queue<TIMER> m_timers;
+    std::thread m_timerThread;
+    bool m_timersStopping = false;
+    std::mutex m_timerMutex;
+    std::condition_variable m_timerWake;
+
+    std::array<pplx::scheduler_ptr, _LANE_COUNT> m_schedulers;
+};
+
+#endif //INVENTREE_REQUEST_EXECUTOR_H
@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "request_policy.h"
+
+#include <algorithm>
+#include <random>
+
+std::chrono::milliseconds REQUEST_POLICY::backoff(int attempt) const {
+    // each thread keeps its own generator, so concurrent retries never share state
+    static thread_local std::mt19937 generator(std::random_device{}());
+
+    long long cap = m_backoffBase.count() << std::min(attempt, 16);
+    cap = std::min(cap, static_cast<long long>(m_backoffMax.count()));
+
+    std::uniform_int_distribution<long long> distribution(0, std::max(cap, 0LL));
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+std::chrono::milliseconds REQUEST_POLICY::attemptTimeout(int attempt, int maxAttempts,
+                                                          std::chrono::milliseconds left) const {
+    if (m_attemptTimeout.count() > 0)
+        return std::min(m_attemptTimeout, left);
+
+    if (attempt >= maxAttempts)
+        return left;
+
+    std::chrono::milliseconds share = m_deadline / (std::max(m_maxRetries, 0) + 1);
+    return std::min(std::max(share, m_minAttemptTimeout), left);
+}
+
+LATENCY_TRACKER::LATENCY_TRACKER(const LATENCY_TRACKER &other) {
+    *this = other;
+}
+
+LATENCY_TRACKER &LATENCY_TRACKER::operator=(const LATENCY_TRACKER &other) {
+    if (this == &other)
+        return *this;
+
+    std::lock(m_mutex, other.m_mutex);
+    std::lock_guard<std::mutex> lock(m_mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> otherLock(other.m_mutex, std::adopt_lock);
+
+    m_samples = other.m_samples;
+    m_next = other.m_next;
+    m_count = other.m_count;
+
+    return *this;
+}
+
+void LATENCY_TRACKER::add(std::chrono::microseconds latency) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_samples.empty())
+        return;
+
+    m_samples[m_next] = latency;
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+std::chrono::microseconds LATENCY_TRACKER::percentile(double p, size_t minSamples) const {
+    std::vector<std::chrono::microseconds> sorted;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_count == 0 || m_count < minSamples)
+            return std::chrono::microseconds(0);
+
+        sorted.assign(m_samples.begin(), m_samples.begin() + m_count);
+    }
+
+    size_t idx = std::min(static_cast<size_t>(p * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+
+    return sorted[idx];
+}
@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_REQUEST_POLICY_H
+#define INVENTREE_REQUEST_POLICY_H
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/**
+ * Time budget and retry behaviour of requests to one InvenTree endpoint
+ */
+struct REQUEST_POLICY {
+    REQUEST_POLICY(int deadlineMs = 10000, int maxRetries = 2, bool hedge = false) {
+        m_deadline = std::chrono::milliseconds(deadlineMs);
+        m_maxRetries = maxRetries;
+        m_hedge = hedge;
+    }
+
+    // total budget of a request including all retries
+    std::chrono::milliseconds m_deadline;
+
+    // budget of a single attempt, 0 splits the deadline evenly between the attempts
+    std::chrono::milliseconds m_attemptTimeout{0};
+    std::chrono::milliseconds m_minAttemptTimeout{1000};
+
+    // GET requests are idempotent and may be repeated after a timeout or a 5xx response
+    int m_maxRetries;
+    std::chrono::milliseconds m_backoffBase{100};
+    std::chrono::milliseconds m_backoffMax{2000};
+
+    // send a second request if the first one is slower than the 95th percentile
+    bool m_hedge;
+    std::chrono::milliseconds m_minHedgeDelay{20};
+
+    /*!
+      Calculates the pause before the next attempt ("full jitter" exponential backoff)
+      @param[in] attempt number of attempts made so far, starting at 1
+      @return random delay between 0 and min(backoffMax, backoffBase * 2^attempt)
+      */
+    std::chrono::milliseconds backoff(int attempt) const;
+
+    /*!
+      Calculates the timeout of an attempt. Without a fixed m_attemptTimeout every attempt gets
+      deadline / (retries + 1), but at least m_minAttemptTimeout, and the last one gets all of the
+      remaining deadline, so a slow but working server still answers
+      @param[in] attempt number of the attempt, starting at 1
+      @param[in] maxAttempts number of attempts the request may take
+      @param[in] left time left until the deadline
+      */
+    std::chrono::milliseconds attemptTimeout(int attempt, int maxAttempts,
+                                             std::chrono::milliseconds left) const;
+};
+
+
+/**
+ * Keeps the most recent response times of an endpoint to derive the hedging delay
+ */
+class LATENCY_TRACKER {
+public:
+    explicit LATENCY_TRACKER(size_t capacity = 128) : m_samples(capacity) {}
+
+    LATENCY_TRACKER(const LATENCY_TRACKER &other);
+
+    LATENCY_TRACKER &operator=(const LATENCY_TRACKER &other);
+
+    void add(std::chrono::microseconds latency);
+
+    /*!
+      Returns the given percentile of the recorded latencies
+      @param[in] p percentile between 0 and 1
+      @return zero if less than minSamples latencies have been recorded
+      */
+    std::chrono::microseconds percentile(double p, size_t minSamples = 20) const;
+
+private:
+    std::vector<std::chrono::microseconds> m_samples;
+    size_t m_next = 0;
+    size_t m_count = 0;
+    mutable std::mutex m_mutex;
+};
+
+#endif //INVENTREE_REQUEST_POLICY_H
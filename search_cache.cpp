@@ -0,0 +1,166 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "search_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+SEARCH_CACHE::SEARCH_CACHE(size_t capacity, std::chrono::seconds maxAge)
+        : m_capacity(capacity), m_maxAge(maxAge) {}
+
+void SEARCH_CACHE::configure(size_t capacity, std::chrono::seconds maxAge) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_capacity = capacity;
+    m_maxAge = maxAge;
+    m_entries.clear();
+}
+
+bool SEARCH_CACHE::lookup(int server, const std::string &term, std::vector<FOUND_PART> &parts) {
+    std::vector<std::string> termWords = words(term);
+    std::shared_ptr<const std::vector<FOUND_PART>> best;
+    bool repeated = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto now = std::chrono::steady_clock::now();
+        auto bestEntry = m_entries.end();
+
+        for (auto entry = m_entries.begin(); entry != m_entries.end();) {
+            if (now - entry->m_created > m_maxAge) {
+                entry = m_entries.erase(entry);
+                continue;
+            }
+
+            // the result set of the same term is the server's answer, it needs no filtering
+            if (entry->m_server == server && !repeated && refines(termWords, entry->m_words) &&
+                (!best || entry->m_words == termWords ||
+                 entry->m_parts->size() < best->size())) {
+                best = entry->m_parts;
+                bestEntry = entry;
+                repeated = entry->m_words == termWords;
+            }
+
+            ++entry;
+        }
+
+        if (!best)
+            return false;
+
+        m_entries.splice(m_entries.begin(), m_entries, bestEntry);
+    }
+
+    // filter outside the lock, the result set itself is immutable
+    std::vector<FOUND_PART> found;
+    for (const auto &part : *best) {
+        if (repeated || matches(part, termWords))
+            found.push_back(part);
+        else if (!part.m_searchComplete)
+            return false;
+    }
+
+    parts.swap(found);
+    return true;
+}
+
+void SEARCH_CACHE::insert(int server, const std::string &term, std::vector<FOUND_PART> parts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_capacity == 0)
+        return;
+
+    std::vector<std::string> termWords = words(term);
+
+    // a repeated search replaces its old result set
+    m_entries.remove_if([&](const ENTRY &entry) {
+        return entry.m_server == server && entry.m_words == termWords;
+    });
+
+    ENTRY entry;
+    entry.m_server = server;
+    entry.m_words = std::move(termWords);
+    entry.m_created = std::chrono::steady_clock::now();
+    entry.m_parts = std::make_shared<const std::vector<FOUND_PART>>(std::move(parts));
+
+    m_entries.push_front(std::move(entry));
+
+    while (m_entries.size() > m_capacity)
+        m_entries.pop_back();
+}
+
+void SEARCH_CACHE::invalidate(int server, int pk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_entries.remove_if([&](const ENTRY &entry) {
+        return entry.m_server == server &&
+               std::any_of(entry.m_parts->begin(), entry.m_parts->end(),
+                           [pk](const FOUND_PART &part) { return part.m_pk == pk; });
+    });
+}
+
+void SEARCH_CACHE::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
+
+std::vector<std::string> SEARCH_CACHE::words(const std::string &term) {
+    std::vector<std::string> result;
+    std::istringstream stream(toLower(term));
+    std::string word;
+
+    while (stream >> word)
+        result.push_back(word);
+
+    return result;
+}
+
+std::string SEARCH_CACHE::toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return str;
+}
+
+bool SEARCH_CACHE::refines(const std::vector<std::string> &term,
+                           const std::vector<std::string> &cached) {
+    // every cached word has to be part of a word of the new term, e.g. "10" -> "10k 0603"
+    for (const auto &cachedWord : cached) {
+        bool contained = false;
+
+        for (const auto &word : term) {
+            if (word.find(cachedWord) != std::string::npos) {
+                contained = true;
+                break;
+            }
+        }
+
+        if (!contained)
+            return false;
+    }
+
+    return true;
+}
+
+bool SEARCH_CACHE::matches(const FOUND_PART &part, const std::vector<std::string> &term) {
+    for (const auto &word : term) {
+        if (part.m_searchText.find(word) == std::string::npos)
+            return false;
+    }
+
+    return true;
+}
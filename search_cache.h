@@ -0,0 +1,135 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_SEARCH_CACHE_H
+#define INVENTREE_SEARCH_CACHE_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <wx/string.h>
+
+/**
+ * A part found by a search. Only the fields needed to list and select the part are kept.
+ */
+struct FOUND_PART {
+    FOUND_PART(int pk, wxString description, std::string image, int server = 0) {
+        m_pk = pk;
+        m_description = description;
+        m_image = image;
+        m_server = server;
+    }
+
+    int m_pk;
+    wxString m_description;
+    wxString m_IPN;
+
+    // server relative url of the part image, empty if there is none
+    std::string m_image;
+
+    // index of the server the part was found on
+    int m_server;
+
+    // pk of the part's category, -1 if it is not known
+    int m_category = -1;
+
+    // lower case name, IPN, revision, description, keywords and tags, the fields a search term is
+    // matched with. Searches of a live server add the category name and the part numbers
+    std::string m_searchText;
+
+    // true if m_searchText holds every field the server searches, only then a part which does
+    // not match locally is known not to match on the server either
+    bool m_searchComplete = false;
+};
+
+
+/*! Keeps the complete result sets of recent searches, so a search which refines one of them (e.g.
+ * "10k 0603" after "10k") can be answered without asking the server again.
+ *
+ * Like InvenTree, a part matches a search term if every word of the term is contained in one of
+ * its fields. A term refines a cached term if every cached word is contained in one of its words,
+ * its results are then a subset of the cached results. Matching is done on the fields in
+ * FOUND_PART::m_searchText. A cached part which does not match locally may still match on the
+ * server through a field which is not held locally (e.g. a supplier part number), such a
+ * refinement is not answered from the cache unless the part's fields are complete.
+ * All methods are thread safe.
+ * */
+class SEARCH_CACHE {
+public:
+    /*!
+      @param[in] capacity number of result sets kept, 0 disables the cache
+      @param[in] maxAge result sets older than this are not used anymore
+      */
+    explicit SEARCH_CACHE(size_t capacity = 32,
+                          std::chrono::seconds maxAge = std::chrono::seconds(60));
+
+    void configure(size_t capacity, std::chrono::seconds maxAge);
+
+    /*!
+      Answers a search from the cached result set of the same term, or else from the smallest
+      cached result set of the same server which the term refines
+      @param[in] server index of the server searched
+      @param[in] term search term as entered
+      @param[out] parts matching parts in the order of the cached result set
+      @return false if no cached result set can answer the search, or if a part would be dropped
+      which might match the search on the server
+      */
+    bool lookup(int server, const std::string &term, std::vector<FOUND_PART> &parts);
+
+    /*!
+      Stores the complete result set of a search, truncated result sets must not be stored
+      */
+    void insert(int server, const std::string &term, std::vector<FOUND_PART> parts);
+
+    /*!
+      Drops the result sets of a server which contain a part, e.g. after the part changed on the
+      server
+      */
+    void invalidate(int server, int pk);
+
+    void clear();
+
+    // splits a search term into lower case words
+    static std::vector<std::string> words(const std::string &term);
+
+    static std::string toLower(std::string str);
+
+private:
+    struct ENTRY {
+        int m_server;
+        std::vector<std::string> m_words;
+        std::chrono::steady_clock::time_point m_created;
+        std::shared_ptr<const std::vector<FOUND_PART>> m_parts;
+    };
+
+    static bool refines(const std::vector<std::string> &term,
+                        const std::vector<std::string> &cached);
+
+    static bool matches(const FOUND_PART &part, const std::vector<std::string> &term);
+
+    size_t m_capacity;
+    std::chrono::seconds m_maxAge;
+
+    // most recently used first
+    std::list<ENTRY> m_entries;
+    std::mutex m_mutex;
+};
+
+#endif //INVENTREE_SEARCH_CACHE_H
@@ -0,0 +1,67 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_SHARED_REGISTRY_H
+#define INVENTREE_SHARED_REGISTRY_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*! Hands out one object per key to every driver instance of the process. The registry only keeps
+ * a weak reference, the object lives as long as an instance holds it and is created again by the
+ * next attach(...) once all of them have let go.
+ * All methods are thread safe.
+ * */
+template<class DATA>
+class SHARED_REGISTRY {
+public:
+    /*!
+      Returns the object of a key, a new one is default constructed if no instance holds it
+      @param[in] key e.g. server url and user
+      @param[out] created set to true if the object was created by this call, if not nullptr
+      */
+    std::shared_ptr<DATA> attach(const std::string &key, bool *created = nullptr) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // objects which were released meanwhile
+        for (auto entry = m_objects.begin(); entry != m_objects.end();) {
+            if (entry->second.expired())
+                entry = m_objects.erase(entry);
+            else
+                ++entry;
+        }
+
+        std::shared_ptr<DATA> object = m_objects[key].lock();
+
+        if (created)
+            *created = !object;
+
+        if (!object) {
+            object = std::make_shared<DATA>();
+            m_objects[key] = object;
+        }
+
+        return object;
+    }
+
+private:
+    std::map<std::string, std::weak_ptr<DATA>> m_objects;
+    std::mutex m_mutex;
+};
+
+#endif //INVENTREE_SHARED_REGISTRY_H
@@ -0,0 +1,464 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "sqlite_library.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <set>
+
+#include <sqlite3.h>
+#include <cpprest/json.h>
+
+namespace {
+// columns the library keeps for itself
+const char *INTERNAL_COLUMNS[] = {"server", "pk", "row_hash"};
+
+const char *SCHEMA =
+        "CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value TEXT);"
+        "CREATE TABLE IF NOT EXISTS parts ("
+        "  server TEXT NOT NULL, pk INTEGER NOT NULL, row_hash TEXT,"
+        "  id TEXT, name TEXT, IPN TEXT, description TEXT, keywords TEXT, category TEXT,"
+        "  location TEXT, image TEXT, in_stock TEXT, units TEXT, datasheet TEXT, symbol TEXT,"
+        "  footprint TEXT,"
+        "  UNIQUE (server, pk));"
+        "CREATE INDEX IF NOT EXISTS parts_id ON parts (id);"
+        "CREATE INDEX IF NOT EXISTS parts_ipn ON parts (IPN);"
+        "CREATE INDEX IF NOT EXISTS parts_name ON parts (name);"
+        "CREATE INDEX IF NOT EXISTS parts_category ON parts (category);"
+        "CREATE VIRTUAL TABLE IF NOT EXISTS parts_fts USING fts5 ("
+        "  name, IPN, description, keywords, content='parts', content_rowid='rowid');"
+        "CREATE TRIGGER IF NOT EXISTS parts_ai AFTER INSERT ON parts BEGIN"
+        "  INSERT INTO parts_fts (rowid, name, IPN, description, keywords)"
+        "  VALUES (new.rowid, new.name, new.IPN, new.description, new.keywords);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS parts_ad AFTER DELETE ON parts BEGIN"
+        "  INSERT INTO parts_fts (parts_fts, rowid, name, IPN, description, keywords)"
+        "  VALUES ('delete', old.rowid, old.name, old.IPN, old.description, old.keywords);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS parts_au AFTER UPDATE ON parts BEGIN"
+        "  INSERT INTO parts_fts (parts_fts, rowid, name, IPN, description, keywords)"
+        "  VALUES ('delete', old.rowid, old.name, old.IPN, old.description, old.keywords);"
+        "  INSERT INTO parts_fts (rowid, name, IPN, description, keywords)"
+        "  VALUES (new.rowid, new.name, new.IPN, new.description, new.keywords);"
+        "END;";
+
+std::string toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return str;
+}
+
+/**
+ * Finalizes a prepared statement when it goes out of scope
+ */
+struct STATEMENT {
+    explicit STATEMENT(sqlite3 *db, const std::string &sql) {
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &m_stmt, nullptr);
+    }
+
+    ~STATEMENT() {
+        sqlite3_finalize(m_stmt);
+    }
+
+    void bind(int index, const std::string *value) {
+        if (value)
+            sqlite3_bind_text(m_stmt, index, value->c_str(), static_cast<int>(value->size()),
+                              SQLITE_TRANSIENT);
+        else
+            sqlite3_bind_null(m_stmt, index);
+    }
+
+    // @return the result of sqlite3_step(...), the statement is reset for the next use
+    int run() {
+        int result = sqlite3_step(m_stmt);
+        sqlite3_reset(m_stmt);
+        sqlite3_clear_bindings(m_stmt);
+        return result;
+    }
+
+    sqlite3_stmt *m_stmt = nullptr;
+};
+}
+
+SQLITE_LIBRARY::~SQLITE_LIBRARY() {
+    sqlite3_close(m_db);
+}
+
+bool SQLITE_LIBRARY::open(const std::string &path, std::string *error) {
+    sqlite3_close(m_db);
+    m_db = nullptr;
+    m_path = path;
+
+    if (sqlite3_open_v2(path.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                        nullptr) != SQLITE_OK) {
+        m_error = m_db ? sqlite3_errmsg(m_db) : "out of memory";
+        sqlite3_close(m_db);
+        m_db = nullptr;
+    } else {
+        // KiCad reads the file while it is updated
+        sqlite3_busy_timeout(m_db, 5000);
+
+        if (execute("PRAGMA journal_mode=WAL;") && execute(SCHEMA)) {
+            execute("INSERT OR REPLACE INTO meta VALUES ('schema_version', '" +
+                    std::to_string(SCHEMA_VERSION) + "');");
+            return true;
+        }
+
+        sqlite3_close(m_db);
+        m_db = nullptr;
+    }
+
+    if (error)
+        *error = m_error;
+
+    return false;
+}
+
+bool SQLITE_LIBRARY::update(const std::string &server, const std::vector<std::string> &parameters,
+                            const std::vector<LIBRARY_ROW> &rows, size_t &written,
+                            size_t &deleted) {
+    written = 0;
+    deleted = 0;
+
+    if (!m_db) {
+        m_error = "database is not open";
+        return false;
+    }
+
+    if (!execute("BEGIN IMMEDIATE;"))
+        return false;
+
+    // a template which is new on the server gets a column, columns are never dropped
+    std::set<std::string> existing;
+    for (const auto &column : columns())
+        existing.insert(toLower(column));
+
+    for (const auto &parameter : parameters) {
+        std::string column = parameterColumn(parameter);
+
+        if (existing.insert(toLower(column)).second &&
+            !execute("ALTER TABLE parts ADD COLUMN " + quote(column) + " TEXT;")) {
+            execute("ROLLBACK;");
+            return false;
+        }
+    }
+
+    // every column is written, so a value removed on the server is cleared as well. Each column
+    // is filled from a fixed value or from the parameter of its template, columns of templates
+    // the server does not have anymore stay empty
+    std::map<std::string, std::string> templates;
+    for (const auto &parameter : parameters)
+        templates[toLower(parameterColumn(parameter))] = parameter;
+
+    const std::vector<std::string> &fixed = fixedColumns();
+    std::vector<std::string> dataColumns;
+    std::vector<std::pair<const std::string *, bool>> sources;
+
+    for (const auto &column : columns()) {
+        if (std::find(std::begin(INTERNAL_COLUMNS), std::end(INTERNAL_COLUMNS), column) !=
+            std::end(INTERNAL_COLUMNS))
+            continue;
+
+        auto isFixed = std::find(fixed.begin(), fixed.end(), column);
+        auto parameter = templates.find(toLower(column));
+
+        dataColumns.push_back(column);
+
+        if (isFixed != fixed.end())
+            sources.emplace_back(&*isFixed, false);
+        else if (parameter != templates.end())
+            sources.emplace_back(&parameter->second, true);
+        else
+            sources.emplace_back(nullptr, true);
+    }
+
+    std::map<int, std::string> hashes;
+    {
+        STATEMENT select(m_db, "SELECT pk, row_hash FROM parts WHERE server = ?1;");
+        select.bind(1, &server);
+
+        while (sqlite3_step(select.m_stmt) == SQLITE_ROW) {
+            const unsigned char *hash = sqlite3_column_text(select.m_stmt, 1);
+            hashes[sqlite3_column_int(select.m_stmt, 0)] =
+                    hash ? reinterpret_cast<const char *>(hash) : "";
+        }
+    }
+
+    std::string assignments;
+    std::string names;
+    std::string placeholders;
+
+    for (size_t i = 0; i < dataColumns.size(); i++) {
+        std::string placeholder = "?" + std::to_string(i + 4);
+
+        assignments += quote(dataColumns[i]) + " = " + placeholder + ", ";
+        names += ", " + quote(dataColumns[i]);
+        placeholders += ", " + placeholder;
+    }
+
+    STATEMENT update(m_db, "UPDATE parts SET " + assignments +
+                           "row_hash = ?3 WHERE server = ?1 AND pk = ?2;");
+    STATEMENT insert(m_db, "INSERT INTO parts (server, pk, row_hash" + names +
+                           ") VALUES (?1, ?2, ?3" + placeholders + ");");
+    STATEMENT remove(m_db, "DELETE FROM parts WHERE server = ?1 AND pk = ?2;");
+
+    if (!update.m_stmt || !insert.m_stmt || !remove.m_stmt) {
+        m_error = sqlite3_errmsg(m_db);
+        execute("ROLLBACK;");
+        return false;
+    }
+
+    std::set<int> current;
+
+    for (const auto &row : rows) {
+        current.insert(row.m_pk);
+
+        std::vector<const std::string *> values;
+        for (const auto &source : sources) {
+            const std::map<std::string, std::string> &map = source.second ? row.m_parameters
+                                                                          : row.m_values;
+            auto value = source.first ? map.find(*source.first) : map.end();
+
+            values.push_back(value != map.end() && !value->second.empty() ? &value->second
+                                                                          : nullptr);
+        }
+
+        std::string hash = rowHash(dataColumns, values);
+        auto known = hashes.find(row.m_pk);
+
+        if (known != hashes.end() && known->second == hash)
+            continue;
+
+        STATEMENT &statement = known != hashes.end() ? update : insert;
+        std::string pk = std::to_string(row.m_pk);
+
+        statement.bind(1, &server);
+        statement.bind(2, &pk);
+        statement.bind(3, &hash);
+
+        for (size_t i = 0; i < values.size(); i++)
+            statement.bind(static_cast<int>(i + 4), values[i]);
+
+        if (statement.run() != SQLITE_DONE) {
+            m_error = sqlite3_errmsg(m_db);
+            execute("ROLLBACK;");
+            return false;
+        }
+
+        written++;
+    }
+
+    for (const auto &known : hashes) {
+        if (current.count(known.first))
+            continue;
+
+        std::string pk = std::to_string(known.first);
+        remove.bind(1, &server);
+        remove.bind(2, &pk);
+
+        if (remove.run() != SQLITE_DONE) {
+            m_error = sqlite3_errmsg(m_db);
+            execute("ROLLBACK;");
+            return false;
+        }
+
+        deleted++;
+    }
+
+    long long now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+    STATEMENT refreshed(m_db, "INSERT OR REPLACE INTO meta VALUES (?1, ?2);");
+    std::string key = "refreshed " + server;
+    std::string value = std::to_string(now);
+    refreshed.bind(1, &key);
+    refreshed.bind(2, &value);
+    refreshed.run();
+
+    if (!execute("COMMIT;")) {
+        execute("ROLLBACK;");
+        return false;
+    }
+
+    // keeps the query planner statistics of the indexes current
+    execute("PRAGMA optimize;");
+
+    return true;
+}
+
+bool SQLITE_LIBRARY::writeLibraryDescription(const std::string &path,
+                                             const std::string &name) const {
+    using namespace web;
+
+    // the fields shown by KiCad, with their KiCad name
+    const std::map<std::string, std::string> renamed = {
+            {"name",      "Value"},
+            {"datasheet", "Datasheet"},
+            {"id",        "InvenTree ID"}
+    };
+    const std::set<std::string> hidden = {"symbol", "footprint", "description", "keywords"};
+
+    std::vector<json::value> fields;
+
+    for (const auto &column : columns()) {
+        if (hidden.count(column) || std::find(std::begin(INTERNAL_COLUMNS),
+                                              std::end(INTERNAL_COLUMNS), column) !=
+                                    std::end(INTERNAL_COLUMNS))
+            continue;
+
+        auto kicadName = renamed.find(column);
+
+        json::value field = json::value::object();
+        field[U("column")] = json::value::string(utility::conversions::to_string_t(column));
+        field[U("name")] = json::value::string(utility::conversions::to_string_t(
+                kicadName != renamed.end() ? kicadName->second : column));
+        field[U("visible_on_add")] = json::value::boolean(column == "name");
+        field[U("visible_in_chooser")] = json::value::boolean(
+                column == "name" || column == "IPN" || column == "in_stock");
+        field[U("show_name")] = json::value::boolean(column != "name");
+
+        fields.push_back(field);
+    }
+
+    json::value properties = json::value::object();
+    properties[U("description")] = json::value::string(U("description"));
+    properties[U("keywords")] = json::value::string(U("keywords"));
+
+    json::value library = json::value::object();
+    library[U("name")] = json::value::string(utility::conversions::to_string_t(name));
+    library[U("table")] = json::value::string(U("parts"));
+    library[U("key")] = json::value::string(U("id"));
+    library[U("symbols")] = json::value::string(U("symbol"));
+    library[U("footprints")] = json::value::string(U("footprint"));
+    library[U("fields")] = json::value::array(fields);
+    library[U("properties")] = properties;
+
+    json::value source = json::value::object();
+    source[U("type")] = json::value::string(U("odbc"));
+    source[U("dsn")] = json::value::string(U(""));
+    source[U("username")] = json::value::string(U(""));
+    source[U("password")] = json::value::string(U(""));
+    source[U("timeout_seconds")] = json::value::number(2);
+    source[U("connection_string")] = json::value::string(utility::conversions::to_string_t(
+            "Driver=SQLite3;Database=" + m_path));
+
+    json::value meta = json::value::object();
+    meta[U("version")] = json::value::number(0);
+
+    json::value description = json::value::object();
+    description[U("meta")] = meta;
+    description[U("name")] = json::value::string(utility::conversions::to_string_t(name));
+    description[U("description")] = json::value::string(U("Parts exported from InvenTree"));
+    description[U("source")] = source;
+    description[U("libraries")] = json::value::array({library});
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << utility::conversions::to_utf8string(description.serialize());
+
+    return static_cast<bool>(file);
+}
+
+std::string SQLITE_LIBRARY::parameterColumn(const std::string &name) {
+    std::string lower = toLower(name);
+
+    for (const auto &column : fixedColumns()) {
+        if (toLower(column) == lower)
+            return "parameter_" + name;
+    }
+
+    for (const char *column : INTERNAL_COLUMNS) {
+        if (column == lower || lower == "rowid")
+            return "parameter_" + name;
+    }
+
+    return name;
+}
+
+const std::vector<std::string> &SQLITE_LIBRARY::fixedColumns() {
+    static const std::vector<std::string> columns = {
+            "id", "name", "IPN", "description", "keywords", "category", "location", "image",
+            "in_stock", "units", "datasheet", "symbol", "footprint"
+    };
+
+    return columns;
+}
+
+bool SQLITE_LIBRARY::execute(const std::string &sql) {
+    char *message = nullptr;
+
+    if (sqlite3_exec(m_db, sql.c_str(), nullptr, nullptr, &message) == SQLITE_OK)
+        return true;
+
+    m_error = message ? message : sqlite3_errmsg(m_db);
+    sqlite3_free(message);
+
+    return false;
+}
+
+std::vector<std::string> SQLITE_LIBRARY::columns() const {
+    std::vector<std::string> names;
+    STATEMENT info(m_db, "PRAGMA table_info(parts);");
+
+    while (info.m_stmt && sqlite3_step(info.m_stmt) == SQLITE_ROW)
+        names.emplace_back(reinterpret_cast<const char *>(sqlite3_column_text(info.m_stmt, 1)));
+
+    return names;
+}
+
+std::string SQLITE_LIBRARY::quote(const std::string &identifier) {
+    std::string quoted = "\"";
+
+    for (char c : identifier) {
+        quoted += c;
+
+        if (c == '"')
+            quoted += '"';
+    }
+
+    return quoted + "\"";
+}
+
+std::string SQLITE_LIBRARY::rowHash(const std::vector<std::string> &columns,
+                                    const std::vector<const std::string *> &values) {
+    // FNV-1a over the columns which have a value, so a new column does not change the hash of
+    // rows without a value in it
+    uint64_t hash = 14695981039346656037ULL;
+
+    auto add = [&hash](const std::string &text) {
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+
+        hash ^= 0x1f;
+        hash *= 1099511628211ULL;
+    };
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (!values[i])
+            continue;
+
+        add(toLower(columns[i]));
+        add(*values[i]);
+    }
+
+    return std::to_string(hash);
+}
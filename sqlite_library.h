@@ -0,0 +1,117 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_SQLITE_LIBRARY_H
+#define INVENTREE_SQLITE_LIBRARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct sqlite3;
+
+/**
+ * A part as it is written to the database library, columns without a value are written as NULL
+ */
+struct LIBRARY_ROW {
+    int m_pk;
+
+    // fixed column -> value, see SQLITE_LIBRARY::fixedColumns()
+    std::map<std::string, std::string> m_values;
+
+    // parameter template name -> value
+    std::map<std::string, std::string> m_parameters;
+};
+
+
+/*! A SQLite database with the parts of the connected InvenTree servers, laid out so KiCad can
+ * browse it as a database library: one row per part in the table "parts", one column per
+ * parameter template, indexes on IPN, name and category and a FTS5 index over name, IPN,
+ * description and keywords which triggers keep in sync.
+ *
+ * Every row carries a hash of its values. An update only writes the rows which are new or
+ * changed and deletes the parts the server does not have anymore, so refreshing a large
+ * catalog rewrites few rows and KiCad can keep reading the file meanwhile.
+ * The methods are not thread safe.
+ * */
+class SQLITE_LIBRARY {
+public:
+    SQLITE_LIBRARY() = default;
+
+    ~SQLITE_LIBRARY();
+
+    SQLITE_LIBRARY(const SQLITE_LIBRARY &) = delete;
+
+    SQLITE_LIBRARY &operator=(const SQLITE_LIBRARY &) = delete;
+
+    /*!
+      Opens or creates the database and its schema
+      @param[in] path database file
+      @param[out] error why the database can not be used, if it is not nullptr
+      */
+    bool open(const std::string &path, std::string *error = nullptr);
+
+    /*!
+      Brings the parts of one server up to date in a single transaction
+      @param[in] server url of the server, the parts of other servers are left alone
+      @param[in] parameters names of all parameter templates, missing columns are added
+      @param[in] rows all parts of the server
+      @param[out] written number of new or changed parts
+      @param[out] deleted number of parts which were removed
+      @return bool returns true if the transaction was committed
+      */
+    bool update(const std::string &server, const std::vector<std::string> &parameters,
+                const std::vector<LIBRARY_ROW> &rows, size_t &written, size_t &deleted);
+
+    /*!
+      Writes a KiCad database library description (.kicad_dbl) which reads the parts table
+      through the SQLite ODBC driver, every column becomes a field
+      @param[in] path file to write
+      @param[in] name library name shown in KiCad
+      */
+    bool writeLibraryDescription(const std::string &path, const std::string &name) const;
+
+    // error message of the last failed call
+    const std::string &error() const { return m_error; }
+
+    /*!
+      Column of a parameter template, prefixed with "parameter_" if the name is taken by one of
+      the fixed columns
+      */
+    static std::string parameterColumn(const std::string &name);
+
+    // columns every part has, filled by the driver
+    static const std::vector<std::string> &fixedColumns();
+
+    static const int SCHEMA_VERSION = 1;
+
+private:
+    bool execute(const std::string &sql);
+
+    // columns of the parts table, in table order
+    std::vector<std::string> columns() const;
+
+    static std::string quote(const std::string &identifier);
+
+    static std::string rowHash(const std::vector<std::string> &columns,
+                               const std::vector<const std::string *> &values);
+
+    sqlite3 *m_db = nullptr;
+    std::string m_path;
+    std::string m_error;
+};
+
+#endif //INVENTREE_SQLITE_LIBRARY_H
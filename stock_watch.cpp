@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "stock_watch.h"
+
+STOCK_WATCH::STOCK_WATCH(size_t capacity) : m_capacity(capacity) {}
+
+void STOCK_WATCH::configure(size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_capacity = capacity;
+    m_entries.clear();
+    m_etags.clear();
+}
+
+void STOCK_WATCH::watch(int server, int pk, const wxString &inStock) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_capacity == 0)
+        return;
+
+    m_entries.remove_if([&](const ENTRY &entry) {
+        return entry.m_server == server && entry.m_pk == pk;
+    });
+
+    m_entries.push_front(ENTRY{server, pk, inStock});
+
+    while (m_entries.size() > m_capacity)
+        m_entries.pop_back();
+}
+
+std::vector<int> STOCK_WATCH::parts(int server) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<int> pks;
+    for (const auto &entry : m_entries) {
+        if (entry.m_server == server)
+            pks.push_back(entry.m_pk);
+    }
+
+    return pks;
+}
+
+bool STOCK_WATCH::empty() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.empty();
+}
+
+bool STOCK_WATCH::update(int server, int pk, const wxString &inStock) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto &entry : m_entries) {
+        if (entry.m_server != server || entry.m_pk != pk)
+            continue;
+
+        if (entry.m_inStock == inStock)
+            return false;
+
+        entry.m_inStock = inStock;
+        return true;
+    }
+
+    return false;
+}
+
+std::string STOCK_WATCH::etag(const std::string &key) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_etags.find(key);
+    return found != m_etags.end() ? found->second : std::string();
+}
+
+void STOCK_WATCH::setEtag(const std::string &key, const std::string &etag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // keys of parts which are not watched anymore are never asked for again
+    if (m_etags.size() > 4 * m_capacity + 8)
+        m_etags.clear();
+
+    if (etag.empty())
+        m_etags.erase(key);
+    else
+        m_etags[key] = etag;
+}
@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_STOCK_WATCH_H
+#define INVENTREE_STOCK_WATCH_H
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <wx/string.h>
+
+/*! The parts whose stock is kept up to date after they have been shown, with the stock last seen
+ * of each. The most recently selected parts are watched, the oldest one is dropped once the watch
+ * is full.
+ *
+ * The ETags of the last poll responses are kept here as well, so an unchanged stock costs the
+ * server a 304 without a body.
+ * All methods are thread safe.
+ * */
+class STOCK_WATCH {
+public:
+    /*!
+      @param[in] capacity number of parts watched, 0 disables the watch
+      */
+    explicit STOCK_WATCH(size_t capacity = 16);
+
+    // also drops the watched parts and the ETags
+    void configure(size_t capacity);
+
+    /*!
+      Starts watching a part, or moves it to the front if it is watched already
+      @param[in] server index of the server the part was found on
+      @param[in] pk primary key of the part
+      @param[in] inStock stock as shown
+      */
+    void watch(int server, int pk, const wxString &inStock);
+
+    // pks of the parts watched on a server, most recently selected first
+    std::vector<int> parts(int server) const;
+
+    bool empty() const;
+
+    /*!
+      Records the stock of a part
+      @return bool returns true if the part is watched and its stock differs from the one last
+              seen
+      */
+    bool update(int server, int pk, const wxString &inStock);
+
+    /*!
+      ETag of the last response to a poll
+      @param[in] key url and query of the poll
+      @return an empty string if there is none
+      */
+    std::string etag(const std::string &key) const;
+
+    void setEtag(const std::string &key, const std::string &etag);
+
+private:
+    struct ENTRY {
+        int m_server;
+        int m_pk;
+        wxString m_inStock;
+    };
+
+    size_t m_capacity;
+
+    // most recently selected first
+    std::list<ENTRY> m_entries;
+
+    std::map<std::string, std::string> m_etags;
+    mutable std::mutex m_mutex;
+};
+
+#endif //INVENTREE_STOCK_WATCH_H
@@ -0,0 +1,266 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "traffic_capture.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+using namespace web::http;
+
+namespace {
+const char *TRAFFIC_FILE_HEADER = "INVENTREE-TRAFFIC 3\n";
+
+// stands in for the API token in a capture, replaying does not check it
+const char *REDACTED_TOKEN = "{\"token\": \"redacted\"}";
+
+std::string lower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return str;
+}
+
+// headers which describe the transfer rather than the response, or carry credentials
+bool isRecordedHeader(const std::string &name) {
+    std::string key = lower(name);
+
+    return key != "content-length" && key != "transfer-encoding" && key != "connection" &&
+           key != "keep-alive" && key != "set-cookie" && key != "authorization" &&
+           key != "www-authenticate";
+}
+
+std::string serializeHeaders(const TRAFFIC_RECORD &record) {
+    std::string text;
+
+    for (const auto &header : record.m_headers)
+        text += header.first + ": " + header.second + "\n";
+
+    return text;
+}
+
+void parseHeaders(const std::string &text, TRAFFIC_RECORD &record) {
+    size_t start = 0;
+
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            end = text.size();
+
+        std::string line = text.substr(start, end - start);
+        size_t colon = line.find(": ");
+
+        if (colon != std::string::npos)
+            record.m_headers.emplace_back(line.substr(0, colon), line.substr(colon + 2));
+
+        start = end + 1;
+    }
+}
+
+http_response makeResponse(const TRAFFIC_RECORD &record) {
+    http_response response(static_cast<status_code>(record.m_status));
+    response.set_body(record.m_body);
+
+    // set_body() defaults to application/octet-stream, the recorded headers replace it
+    for (const auto &header : record.m_headers) {
+        if (lower(header.first) == "content-type")
+            response.headers().set_content_type(header.second);
+        else
+            response.headers().add(header.first, header.second);
+    }
+
+    return response;
+}
+}
+
+TRAFFIC_FILE::~TRAFFIC_FILE() {
+    if (m_file)
+        fclose(m_file);
+}
+
+std::shared_ptr<TRAFFIC_FILE> TRAFFIC_FILE::openForRecording(const std::string &path) {
+    std::shared_ptr<TRAFFIC_FILE> traffic(new TRAFFIC_FILE());
+
+    traffic->m_file = fopen(path.c_str(), "wb");
+    if (!traffic->m_file)
+        return nullptr;
+
+    fputs(TRAFFIC_FILE_HEADER, traffic->m_file);
+
+    return traffic;
+}
+
+std::shared_ptr<TRAFFIC_FILE> TRAFFIC_FILE::openForReplay(const std::string &path) {
+    std::shared_ptr<TRAFFIC_FILE> traffic(new TRAFFIC_FILE());
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return nullptr;
+
+    bool valid = traffic->read(file);
+    fclose(file);
+
+    return valid ? traffic : nullptr;
+}
+
+bool TRAFFIC_FILE::read(FILE *file) {
+    char header[32] = {0};
+    if (!fgets(header, sizeof(header), file))
+        return false;
+
+    if (std::string(header) != TRAFFIC_FILE_HEADER)
+        return false;
+
+    char method[16];
+    int status;
+    long long latency;
+    size_t resourceBytes, headerBytes, bodyBytes;
+
+    while (fscanf(file, "%15s %d %lld %zu %zu %zu", method, &status, &latency, &resourceBytes,
+                  &headerBytes, &bodyBytes) == 6) {
+        if (fgetc(file) != '\n')
+            return false;
+
+        std::shared_ptr<TRAFFIC_RECORD> record = std::make_shared<TRAFFIC_RECORD>();
+        record->m_method = method;
+        record->m_status = status;
+        record->m_latencyUs = latency;
+        record->m_resource.resize(resourceBytes);
+        record->m_body.resize(bodyBytes);
+
+        std::string headers(headerBytes, '\0');
+
+        if ((resourceBytes &&
+             fread(&record->m_resource[0], 1, resourceBytes, file) != resourceBytes) ||
+            (headerBytes && fread(&headers[0], 1, headerBytes, file) != headerBytes) ||
+            (bodyBytes && fread(record->m_body.data(), 1, bodyBytes, file) != bodyBytes) ||
+            fgetc(file) != '\n') {
+            // truncated capture, e.g. KiCad was closed while recording
+            break;
+        }
+
+        parseHeaders(headers, *record);
+
+        m_replay[key(record->m_method, record->m_resource)].m_records.emplace_back(record);
+        m_count++;
+    }
+
+    return m_count > 0;
+}
+
+void TRAFFIC_FILE::append(const TRAFFIC_RECORD &record) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_file)
+        return;
+
+    std::string headers = serializeHeaders(record);
+
+    fprintf(m_file, "%s %d %lld %zu %zu %zu\n", record.m_method.c_str(), record.m_status,
+            record.m_latencyUs, record.m_resource.size(), headers.size(), record.m_body.size());
+    fwrite(record.m_resource.data(), 1, record.m_resource.size(), m_file);
+    fwrite(headers.data(), 1, headers.size(), m_file);
+    fwrite(record.m_body.data(), 1, record.m_body.size(), m_file);
+    fputc('\n', m_file);
+    fflush(m_file);
+
+    m_count++;
+}
+
+std::shared_ptr<const TRAFFIC_RECORD> TRAFFIC_FILE::next(const std::string &method,
+                                                         const std::string &resource) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_replay.find(key(method, resource));
+    if (it == m_replay.end())
+        return nullptr;
+
+    REPLAY_ENTRY &entry = it->second;
+    std::shared_ptr<const TRAFFIC_RECORD> record = entry.m_records[entry.m_next];
+    entry.m_next = (entry.m_next + 1) % entry.m_records.size();
+
+    return record;
+}
+
+size_t TRAFFIC_FILE::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+std::string TRAFFIC_FILE::key(const std::string &method, const std::string &resource) {
+    return method + " " + resource;
+}
+
+pplx::task<http_response> TRAFFIC_RECORD_STAGE::propagate(http_request request) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<TRAFFIC_FILE> file = m_file;
+
+    TRAFFIC_RECORD head;
+    head.m_method = request.method();
+    head.m_resource = request.absolute_uri().resource().to_string();
+
+    std::string path = request.absolute_uri().path();
+    bool token = path.size() >= 11 && path.compare(path.size() - 11, 11, "user/token/") == 0;
+
+    return next_stage()->propagate(request).then([=](http_response response) {
+        // the body can only be read once, so hand a copy on to the driver
+        return response.extract_vector().then([=](std::vector<unsigned char> body) {
+            TRAFFIC_RECORD record = head;
+            record.m_status = response.status_code();
+            record.m_latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            record.m_body = body;
+
+            for (const auto &header : response.headers()) {
+                if (isRecordedHeader(header.first))
+                    record.m_headers.emplace_back(header.first, header.second);
+            }
+
+            // captures are shared, they get a stand-in for the token. It may be compressed, so
+            // the body is replaced as a whole
+            TRAFFIC_RECORD shared = record;
+
+            if (token && record.m_status == status_codes::OK) {
+                shared.m_headers.clear();
+                shared.m_headers.emplace_back("Content-Type", "application/json");
+                shared.m_body.assign(REDACTED_TOKEN, REDACTED_TOKEN + strlen(REDACTED_TOKEN));
+            }
+
+            file->append(shared);
+
+            return makeResponse(record);
+        });
+    });
+}
+
+pplx::task<http_response> TRAFFIC_REPLAY_STAGE::propagate(http_request request) {
+    std::shared_ptr<const TRAFFIC_RECORD> record = m_file->next(
+            request.method(), request.absolute_uri().resource().to_string());
+
+    if (!record)
+        return pplx::task_from_result(http_response(status_codes::NotFound));
+
+    auto delay = std::chrono::microseconds(
+            static_cast<long long>(record->m_latencyUs * m_latencyScale));
+
+    if (delay.count() <= 0)
+        return pplx::task_from_result(makeResponse(*record));
+
+    return m_executor.delay(delay).then([record]() {
+        return makeResponse(*record);
+    });
+}
@@ -0,0 +1,147 @@
+/*
+ *
+ * Copyright (C) 2021 Andre Iwers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef INVENTREE_TRAFFIC_CAPTURE_H
+#define INVENTREE_TRAFFIC_CAPTURE_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cpprest/http_client.h>
+
+#include "request_executor.h"
+
+/**
+ * A single request/response pair as captured from the InvenTree API.
+ * The resource is the path and query of the request, so a capture can be replayed against any
+ * server url.
+ */
+struct TRAFFIC_RECORD {
+    std::string m_method;
+    std::string m_resource;
+    int m_status = 0;
+    long long m_latencyUs = 0;
+
+    // response headers, e.g. ETag and Content-Encoding, without those describing the transfer
+    std::vector<std::pair<std::string, std::string>> m_headers;
+    std::vector<unsigned char> m_body;
+};
+
+/*! A capture file holding TRAFFIC_RECORDs.
+ * The format is a header line followed by one record per entry:
+ *
+ *     INVENTREE-TRAFFIC 3
+ *     <method> <status> <latency us> <resource bytes> <header bytes> <body bytes>
+ *     <resource><headers><body>
+ *
+ * The headers are stored as "<name>: <value>\n" lines, the body as received, i.e. still
+ * compressed.
+ * All methods are thread safe.
+ * */
+class TRAFFIC_FILE {
+public:
+    ~TRAFFIC_FILE();
+
+    /*!
+      Creates (truncates) a capture file
+      @param[in] path file to write to
+      @return nullptr if the file could not be created
+      */
+    static std::shared_ptr<TRAFFIC_FILE> openForRecording(const std::string &path);
+
+    /*!
+      Loads a complete capture file into memory
+      @param[in] path file to read from
+      @return nullptr if the file could not be read or has an unknown version
+      */
+    static std::shared_ptr<TRAFFIC_FILE> openForReplay(const std::string &path);
+
+    void append(const TRAFFIC_RECORD &record);
+
+    /*!
+      Returns the next recorded response for a request. If a request was recorded several times,
+      the responses are handed out in their original order and then start over again
+      @return nullptr if the request has not been recorded
+      */
+    std::shared_ptr<const TRAFFIC_RECORD> next(const std::string &method,
+                                               const std::string &resource);
+
+    size_t size() const;
+
+private:
+    TRAFFIC_FILE() = default;
+
+    bool read(FILE *file);
+
+    static std::string key(const std::string &method, const std::string &resource);
+
+    struct REPLAY_ENTRY {
+        std::vector<std::shared_ptr<const TRAFFIC_RECORD>> m_records;
+        size_t m_next = 0;
+    };
+
+    FILE *m_file = nullptr;
+    size_t m_count = 0;
+    std::map<std::string, REPLAY_ENTRY> m_replay;
+    mutable std::mutex m_mutex;
+};
+
+
+/*! http_client pipeline stage which forwards every request to the server and appends the
+ * request/response pair including its latency to a TRAFFIC_FILE.
+ * Captures are meant to be shared, so credentials are not recorded: the API token is replaced in
+ * the answer of user/token/, cookies and authentication headers are left out.
+ * */
+class TRAFFIC_RECORD_STAGE : public web::http::http_pipeline_stage {
+public:
+    explicit TRAFFIC_RECORD_STAGE(std::shared_ptr<TRAFFIC_FILE> file) : m_file(std::move(file)) {}
+
+    pplx::task<web::http::http_response> propagate(web::http::http_request request) override;
+
+private:
+    std::shared_ptr<TRAFFIC_FILE> m_file;
+};
+
+
+/*! http_client pipeline stage which answers every request from a TRAFFIC_FILE without contacting
+ * the server. Requests which have not been recorded are answered with 404. The recorded latency
+ * is waited for with the executor's timer, no thread is held while a response is due.
+ * */
+class TRAFFIC_REPLAY_STAGE : public web::http::http_pipeline_stage {
+public:
+    /*!
+      @param[in] file capture to replay
+      @param[in] latencyScale factor applied to the recorded latencies, 0 answers immediately
+      @param[in] executor times the answers, must outlive the requests
+      */
+    TRAFFIC_REPLAY_STAGE(std::shared_ptr<TRAFFIC_FILE> file, double latencyScale,
+                         REQUEST_EXECUTOR &executor)
+            : m_file(std::move(file)), m_latencyScale(latencyScale), m_executor(executor) {}
+
+    pplx::task<web::http::http_response> propagate(web::http::http_request request) override;
+
+private:
+    std::shared_ptr<TRAFFIC_FILE> m_file;
+    double m_latencyScale;
+    REQUEST_EXECUTOR &m_executor;
+};
+
+#endif //INVENTREE_TRAFFIC_CAPTURE_H